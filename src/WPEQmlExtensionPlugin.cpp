@@ -21,15 +21,22 @@
 #include "config.h"
 #include "WPEQmlExtensionPlugin.h"
 
+#include "WPEQtMainContext.h"
 #include "WPEQtView.h"
 #include "WPEQtViewLoadRequest.h"
+#include "WPEQtWebsiteData.h"
 #include <qqml.h>
 
 void WPEQmlExtensionPlugin::registerTypes(const char* uri)
 {
     // @uri org.wpewebkit.qtwpe
     qmlRegisterType<WPEQtView>(uri, 1, 0, "WPEView");
+    qmlRegisterType<WPEQtWebsiteData>(uri, 1, 0, "WPEWebsiteData");
 
-    const QString& msg = QObject::tr("Cannot create separate instance of WPEQtViewLoadRequest");
-    qmlRegisterUncreatableType<WPEQtViewLoadRequest>(uri, 1, 0, "WPEViewLoadRequest", msg);
+    // WPEViewLoadRequest is a value type handed out by loadingChanged().
+    qRegisterMetaType<WPEQtViewLoadRequest>();
+
+    // WebKit callbacks starve unless its main context is dispatched, check
+    // that the event dispatcher does it before any view is created.
+    WPEQtMainContext::initialize();
 }
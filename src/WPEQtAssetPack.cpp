@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtAssetPack.h"
+
+#include <QFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <wtf/glib/GRefPtr.h>
+#include <wtf/glib/GUniquePtr.h>
+
+using namespace WPEQtAssetPackFormat;
+
+std::unique_ptr<WPEQtAssetPackSchemeHandler> WPEQtAssetPackSchemeHandler::open(const QString& path)
+{
+    GUniqueOutPtr<GError> error;
+    GMappedFile* file = g_mapped_file_new(QFile::encodeName(path).constData(), FALSE, &error.outPtr());
+    if (!file) {
+        qWarning("Failed to open asset pack %s: %s", qPrintable(path), error->message);
+        return nullptr;
+    }
+    GBytes* pack = g_mapped_file_get_bytes(file);
+    g_mapped_file_unref(file);
+
+    // Everything is validated once here, requests only index the mapping.
+    gsize size;
+    auto* data = static_cast<const char*>(g_bytes_get_data(pack, &size));
+    const auto* header = reinterpret_cast<const Header*>(data);
+    bool valid = size >= sizeof(Header) && !memcmp(header->magic, magic, sizeof(magic))
+        && qFromLittleEndian(header->version) == version;
+    const quint32 entryCount = valid ? qFromLittleEndian(header->entryCount) : 0;
+    valid = valid && entryCount <= (size - sizeof(Header)) / sizeof(Entry);
+
+    const auto* entries = reinterpret_cast<const Entry*>(data + sizeof(Header));
+    for (quint32 i = 0; valid && i < entryCount; ++i) {
+        const Entry& entry = entries[i];
+        valid = quint64(qFromLittleEndian(entry.pathOffset)) + qFromLittleEndian(entry.pathLength) <= size
+            && qFromLittleEndian(entry.dataOffset) <= size
+            && qFromLittleEndian(entry.storedSize) <= size - qFromLittleEndian(entry.dataOffset);
+    }
+
+    if (!valid) {
+        qWarning("Invalid asset pack %s", qPrintable(path));
+        g_bytes_unref(pack);
+        return nullptr;
+    }
+
+    return std::unique_ptr<WPEQtAssetPackSchemeHandler>(new WPEQtAssetPackSchemeHandler(pack, entryCount));
+}
+
+WPEQtAssetPackSchemeHandler::WPEQtAssetPackSchemeHandler(GBytes* pack, quint32 entryCount)
+    : m_pack(pack)
+    , m_data(static_cast<const char*>(g_bytes_get_data(pack, nullptr)))
+    , m_entryCount(entryCount)
+{
+}
+
+WPEQtAssetPackSchemeHandler::~WPEQtAssetPackSchemeHandler()
+{
+    g_bytes_unref(m_pack);
+}
+
+const Entry* WPEQtAssetPackSchemeHandler::entries() const
+{
+    return reinterpret_cast<const Entry*>(m_data + sizeof(Header));
+}
+
+QByteArray WPEQtAssetPackSchemeHandler::entryPath(const Entry& entry) const
+{
+    return QByteArray::fromRawData(m_data + qFromLittleEndian(entry.pathOffset), qFromLittleEndian(entry.pathLength));
+}
+
+const Entry* WPEQtAssetPackSchemeHandler::find(const QByteArray& path) const
+{
+    const Entry* begin = entries();
+    const Entry* end = begin + m_entryCount;
+    const Entry* entry = std::lower_bound(begin, end, path, [this](const Entry& entry, const QByteArray& path) {
+        return entryPath(entry) < path;
+    });
+    if (entry == end || entryPath(*entry) != path)
+        return nullptr;
+    return entry;
+}
+
+void WPEQtAssetPackSchemeHandler::handleRequest(WebKitURISchemeRequest* request)
+{
+    QByteArray path = requestPath(request).toUtf8();
+    if (!path.startsWith('/'))
+        path.prepend('/');
+    if (path.endsWith('/'))
+        path += "index.html";
+
+    const Entry* entry = find(path);
+    if (!entry)
+        entry = find(path + "/index.html");
+    if (!entry) {
+        finishWithError(request, QStringLiteral("Asset not found: %1").arg(QString::fromUtf8(path)));
+        return;
+    }
+
+    const QString mimeType = mimeTypeForPath(QString::fromUtf8(entryPath(*entry)));
+    GBytes* data = g_bytes_new_from_bytes(m_pack, qFromLittleEndian(entry->dataOffset), qFromLittleEndian(entry->storedSize));
+    if (!(qFromLittleEndian(entry->flags) & Compressed)) {
+        finish(request, data, mimeType);
+        return;
+    }
+
+    auto compressed = adoptGRef(g_memory_input_stream_new_from_bytes(data));
+    g_bytes_unref(data);
+    auto decompressor = adoptGRef(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+    auto stream = adoptGRef(g_converter_input_stream_new(compressed.get(), G_CONVERTER(decompressor.get())));
+    finish(request, stream.get(), qFromLittleEndian(entry->size), mimeType);
+}
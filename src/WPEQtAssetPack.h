@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "WPEQtAssetPackFormat.h"
+#include "WPEQtSchemeHandler.h"
+#include <QByteArray>
+
+// Serves the files of an asset pack, a single memory mapped file with a
+// sorted path index. Stored entries are handed to WebKit as slices of the
+// mapping, compressed ones are inflated while WebKit reads them.
+class WPEQtAssetPackSchemeHandler final : public WPEQtSchemeHandler {
+public:
+    static std::unique_ptr<WPEQtAssetPackSchemeHandler> open(const QString& path);
+    ~WPEQtAssetPackSchemeHandler();
+
+    void handleRequest(WebKitURISchemeRequest*) override;
+
+private:
+    WPEQtAssetPackSchemeHandler(GBytes*, quint32 entryCount);
+
+    const WPEQtAssetPackFormat::Entry* entries() const;
+    QByteArray entryPath(const WPEQtAssetPackFormat::Entry&) const;
+    const WPEQtAssetPackFormat::Entry* find(const QByteArray& path) const;
+
+    GBytes* m_pack;
+    const char* m_data;
+    quint32 m_entryCount;
+};
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+
+// Layout of asset packs, shared by the plugin and the wpeqt-pack tool.
+// All integers are little endian. A pack is a Header, followed by
+// entryCount Entry records sorted by path (byte-wise), the path strings
+// and the file data. Paths are absolute, like "/index.html".
+namespace WPEQtAssetPackFormat {
+
+static const char magic[8] = { 'W', 'P', 'E', 'Q', 'T', 'P', 'A', 'K' };
+static const quint32 version = 1;
+
+enum EntryFlags : quint32 {
+    // The data is a zlib stream inflating to size bytes.
+    Compressed = 1 << 0
+};
+
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 entryCount;
+};
+
+struct Entry {
+    quint32 pathOffset;
+    quint32 pathLength;
+    quint64 dataOffset;
+    quint32 storedSize;
+    quint32 size;
+    quint32 flags;
+    quint32 reserved;
+};
+
+static_assert(sizeof(Header) == 16, "Unexpected asset pack header size");
+static_assert(sizeof(Entry) == 32, "Unexpected asset pack entry size");
+
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtBridge.h"
+
+#include "WPEQtView.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMetaMethod>
+#include <QMetaProperty>
+#include <array>
+
+// Page side of the bridge, injected at document start. Registered objects
+// are exposed as plain objects in qtbridge.objects, updated with deltas, and
+// qtbridge.invoke() returns a Promise resolved with the method result.
+static const char bridgeScript[] = R"JS((function() {
+    if (window.qtbridge)
+        return;
+    var pending = {};
+    var nextCall = 1;
+    var bridge = window.qtbridge = {
+        objects: {},
+        invoke: function(object, method) {
+            var args = Array.prototype.slice.call(arguments, 2);
+            return new Promise(function(resolve, reject) {
+                var id = nextCall++;
+                pending[id] = { resolve: resolve, reject: reject };
+                window.webkit.messageHandlers.__qtbridge.postMessage({ type: "invoke", id: id, object: object, method: method, args: args });
+            });
+        },
+        _receive: function(updates, removed, replies) {
+            for (var name in updates) {
+                var object = bridge.objects[name] || (bridge.objects[name] = {});
+                var properties = updates[name];
+                for (var property in properties)
+                    object[property] = properties[property];
+            }
+            for (var i = 0; i < removed.length; ++i)
+                delete bridge.objects[removed[i]];
+            for (var i = 0; i < replies.length; ++i) {
+                var call = pending[replies[i].id];
+                delete pending[replies[i].id];
+                if (!call)
+                    continue;
+                if (replies[i].error)
+                    call.reject(new Error(replies[i].error));
+                else
+                    call.resolve(replies[i].result);
+            }
+            if (Object.keys(updates).length || removed.length)
+                window.dispatchEvent(new CustomEvent("qtbridgechange", { detail: { updates: updates, removed: removed } }));
+        }
+    };
+    window.webkit.messageHandlers.__qtbridge.postMessage({ type: "ready" });
+})();
+)JS";
+
+static QVariant convertedVariant(const QVariant& value, int type)
+{
+    // A failed conversion still leaves a null value of the requested type.
+    QVariant converted = value;
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+    converted.convert(QMetaType(type));
+#else
+    converted.convert(type);
+#endif
+    return converted;
+}
+
+static QVariant emptyVariant(int type)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+    return QVariant(QMetaType(type));
+#else
+    return QVariant(type, nullptr);
+#endif
+}
+
+static bool callMethod(QObject* object, const QMetaMethod& method, const QVariantList& args, QVariant* result)
+{
+    std::array<QVariant, 10> storage;
+    std::array<QGenericArgument, 10> arguments;
+    if (args.size() > int(arguments.size()))
+        return false;
+
+    const QList<QByteArray> typeNames = method.parameterTypes();
+    for (int i = 0; i < args.size(); ++i) {
+        int type = method.parameterType(i);
+        if (type == QMetaType::QVariant) {
+            storage[i] = args.at(i);
+            arguments[i] = QGenericArgument("QVariant", &storage[i]);
+        } else {
+            storage[i] = convertedVariant(args.at(i), type);
+            arguments[i] = QGenericArgument(typeNames.at(i).constData(), storage[i].data());
+        }
+    }
+
+    int returnType = method.returnType();
+    QVariant returnValue;
+    QGenericReturnArgument returnArgument;
+    if (returnType == QMetaType::QVariant)
+        returnArgument = QGenericReturnArgument("QVariant", &returnValue);
+    else if (returnType != QMetaType::Void && returnType != QMetaType::UnknownType) {
+        returnValue = emptyVariant(returnType);
+        returnArgument = QGenericReturnArgument(method.typeName(), returnValue.data());
+    }
+
+    bool invoked = method.invoke(object, Qt::DirectConnection, returnArgument,
+        arguments[0], arguments[1], arguments[2], arguments[3], arguments[4],
+        arguments[5], arguments[6], arguments[7], arguments[8], arguments[9]);
+    if (invoked)
+        *result = returnValue;
+    return invoked;
+}
+
+WPEQtBridge::WPEQtBridge(WPEQtView* view)
+    : QObject(view)
+    , m_view(view)
+{
+}
+
+WPEQtBridge::~WPEQtBridge()
+{
+}
+
+QByteArray WPEQtBridge::pageScript()
+{
+    return QByteArray::fromRawData(bridgeScript, sizeof(bridgeScript) - 1);
+}
+
+void WPEQtBridge::registerObject(const QString& name, QObject* object)
+{
+    unregisterObject(name);
+    if (!object)
+        return;
+
+    Object& entry = m_objects[name];
+    entry.name = name;
+    entry.object = object;
+    m_objectNames.insert(object, name);
+
+    static const int propertyChangedIndex = staticMetaObject.indexOfSlot("propertyChanged()");
+    const QMetaMethod propertyChangedSlot = staticMetaObject.method(propertyChangedIndex);
+    const QMetaObject* metaObject = object->metaObject();
+    for (int i = QObject::staticMetaObject.propertyCount(); i < metaObject->propertyCount(); ++i) {
+        QMetaProperty property = metaObject->property(i);
+        if (!property.hasNotifySignal())
+            continue;
+
+        int signalIndex = property.notifySignalIndex();
+        auto& properties = entry.notifySignalProperties[signalIndex];
+        if (properties.isEmpty())
+            connect(object, property.notifySignal(), this, propertyChangedSlot);
+        properties.append(i);
+    }
+    connect(object, &QObject::destroyed, this, &WPEQtBridge::objectDestroyed);
+
+    markAllDirty(entry);
+}
+
+void WPEQtBridge::unregisterObject(const QString& name)
+{
+    auto it = m_objects.find(name);
+    if (it == m_objects.end())
+        return;
+
+    if (it->object) {
+        disconnect(it->object, nullptr, this, nullptr);
+        m_objectNames.remove(it->object);
+    }
+    m_objects.erase(it);
+    m_dirtyObjects.remove(name);
+    m_removedObjects.append(name);
+    scheduleFlush();
+}
+
+void WPEQtBridge::objectDestroyed(QObject* object)
+{
+    const QString name = m_objectNames.take(object);
+    if (!name.isNull())
+        unregisterObject(name);
+}
+
+void WPEQtBridge::propertyChanged()
+{
+    auto it = m_objectNames.constFind(sender());
+    if (it == m_objectNames.constEnd())
+        return;
+
+    Object& entry = m_objects[it.value()];
+    for (int property : entry.notifySignalProperties.value(senderSignalIndex()))
+        entry.dirtyProperties.insert(property);
+    m_dirtyObjects.insert(entry.name);
+    scheduleFlush();
+}
+
+void WPEQtBridge::markAllDirty(Object& entry)
+{
+    const QMetaObject* metaObject = entry.object->metaObject();
+    for (int i = QObject::staticMetaObject.propertyCount(); i < metaObject->propertyCount(); ++i)
+        entry.dirtyProperties.insert(i);
+    m_dirtyObjects.insert(entry.name);
+    scheduleFlush();
+}
+
+void WPEQtBridge::scheduleFlush()
+{
+    // Property changes are sent to the page at most once per frame.
+    m_view->scheduleFlush();
+}
+
+void WPEQtBridge::handleMessage(const QVariant& message)
+{
+    const QVariantMap map = message.toMap();
+    const QString type = map.value(QStringLiteral("type")).toString();
+    if (type == QLatin1String("ready")) {
+        // A new document, send it the complete state.
+        for (auto& entry : m_objects) {
+            if (entry.object)
+                markAllDirty(entry);
+        }
+    } else if (type == QLatin1String("invoke"))
+        invoke(map);
+}
+
+void WPEQtBridge::invoke(const QVariantMap& message)
+{
+    QJsonObject reply;
+    reply.insert(QStringLiteral("id"), QJsonValue::fromVariant(message.value(QStringLiteral("id"))));
+
+    auto it = m_objects.constFind(message.value(QStringLiteral("object")).toString());
+    const QByteArray methodName = message.value(QStringLiteral("method")).toString().toUtf8();
+    const QVariantList args = message.value(QStringLiteral("args")).toList();
+
+    QMetaMethod method;
+    if (it != m_objects.constEnd() && it->object) {
+        // QObject's own slots, deleteLater() among them, are not exposed.
+        const QMetaObject* metaObject = it->object->metaObject();
+        for (int i = QObject::staticMetaObject.methodCount(); i < metaObject->methodCount(); ++i) {
+            QMetaMethod candidate = metaObject->method(i);
+            if ((candidate.methodType() == QMetaMethod::Method || candidate.methodType() == QMetaMethod::Slot)
+                && candidate.access() == QMetaMethod::Public
+                && candidate.name() == methodName && candidate.parameterCount() == args.size()) {
+                method = candidate;
+                break;
+            }
+        }
+    }
+
+    QVariant result;
+    if (!method.isValid())
+        reply.insert(QStringLiteral("error"), QStringLiteral("No such method: %1").arg(QString::fromUtf8(methodName)));
+    else if (!callMethod(it->object, method, args, &result))
+        reply.insert(QStringLiteral("error"), QStringLiteral("Failed to invoke %1").arg(QString::fromUtf8(methodName)));
+    else
+        reply.insert(QStringLiteral("result"), QJsonValue::fromVariant(result));
+
+    m_replies.append(reply);
+    scheduleFlush();
+}
+
+void WPEQtBridge::flush()
+{
+    if (m_dirtyObjects.isEmpty() && m_removedObjects.isEmpty() && m_replies.isEmpty())
+        return;
+
+    QJsonObject updates;
+    for (const auto& name : qAsConst(m_dirtyObjects)) {
+        Object& entry = m_objects[name];
+        if (!entry.object)
+            continue;
+
+        QJsonObject properties;
+        const QMetaObject* metaObject = entry.object->metaObject();
+        for (int index : qAsConst(entry.dirtyProperties)) {
+            QMetaProperty property = metaObject->property(index);
+            properties.insert(QString::fromLatin1(property.name()), QJsonValue::fromVariant(property.read(entry.object)));
+        }
+        entry.dirtyProperties.clear();
+        updates.insert(name, properties);
+    }
+
+    QByteArray script("window.qtbridge && window.qtbridge._receive(");
+    script += QJsonDocument(updates).toJson(QJsonDocument::Compact);
+    script += ", ";
+    script += QJsonDocument(m_removedObjects).toJson(QJsonDocument::Compact);
+    script += ", ";
+    script += QJsonDocument(m_replies).toJson(QJsonDocument::Compact);
+    script += ")";
+
+    m_dirtyObjects.clear();
+    m_removedObjects = QJsonArray();
+    m_replies = QJsonArray();
+
+    m_view->runJavaScript(QString::fromUtf8(script));
+}
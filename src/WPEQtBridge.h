@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QJsonArray>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QVariant>
+#include <QVector>
+
+class WPEQtView;
+
+class WPEQtBridge : public QObject {
+    Q_OBJECT
+    Q_DISABLE_COPY(WPEQtBridge)
+
+public:
+    explicit WPEQtBridge(WPEQtView*);
+    ~WPEQtBridge();
+
+    static const char* messageHandlerName() { return "__qtbridge"; }
+    static QByteArray pageScript();
+
+    void registerObject(const QString& name, QObject*);
+    void unregisterObject(const QString& name);
+
+    void handleMessage(const QVariant&);
+    void flush();
+
+private Q_SLOTS:
+    void propertyChanged();
+    void objectDestroyed(QObject*);
+
+private:
+    struct Object {
+        QString name;
+        QPointer<QObject> object;
+        QHash<int, QVector<int>> notifySignalProperties;
+        QSet<int> dirtyProperties;
+    };
+
+    void markAllDirty(Object&);
+    void scheduleFlush();
+    void invoke(const QVariantMap&);
+
+    WPEQtView* m_view;
+    QHash<QString, Object> m_objects;
+    QHash<QObject*, QString> m_objectNames;
+    QSet<QString> m_dirtyObjects;
+    QJsonArray m_removedObjects;
+    QJsonArray m_replies;
+};
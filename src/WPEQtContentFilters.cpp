@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtContentFilters.h"
+
+#include "WPEQtUserContent.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStandardPaths>
+#include <QVector>
+#include <memory>
+#include <wtf/glib/GUniquePtr.h>
+
+// API::Error::Policy::FrameLoadBlockedByContentBlocker in WebKit's
+// Shared/API/APIError.h. It is reported in the WEBKIT_POLICY_ERROR domain
+// but has no WebKitPolicyError value, the public ones end at
+// WEBKIT_POLICY_ERROR_CANNOT_USE_RESTRICTED_PORT (103).
+static const int blockedByContentFilterError = 104;
+
+namespace {
+
+struct PendingFilter {
+    QByteArray rules;
+    QElapsedTimer timer;
+    QVector<WPEQtContentFilters*> waiters;
+};
+
+}
+
+static WebKitUserContentFilterStore* filterStore()
+{
+    static WebKitUserContentFilterStore* store = [] {
+        const QString path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/wpeqt/content-filters");
+        QDir().mkpath(path);
+        return webkit_user_content_filter_store_new(QFile::encodeName(path).constData());
+    }();
+    return store;
+}
+
+// Compiled filters by identifier. They are kept for the lifetime of the
+// process, so views created later do not even load them from disk.
+static QHash<QString, WebKitUserContentFilter*>& compiledFilters()
+{
+    static QHash<QString, WebKitUserContentFilter*> filters;
+    return filters;
+}
+
+static QHash<QString, PendingFilter>& pendingFilters()
+{
+    static QHash<QString, PendingFilter> filters;
+    return filters;
+}
+
+static bool readRules(const QVariant& entry, QString& name, QByteArray& rules)
+{
+    // A plain string is the URL of the JSON rule list.
+    QVariantMap options;
+    if (entry.canConvert<QVariantMap>())
+        options = entry.toMap();
+    else
+        options.insert(QStringLiteral("url"), entry.toUrl());
+
+    name = options.value(QStringLiteral("name"), QStringLiteral("filter")).toString();
+    if (options.contains(QStringLiteral("source"))) {
+        rules = options.value(QStringLiteral("source")).toString().toUtf8();
+        return true;
+    }
+
+    QFile file(localFilePath(options.value(QStringLiteral("url")).toUrl()));
+    if (file.fileName().isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        qWarning("Failed to read content filter %s", qPrintable(name));
+        return false;
+    }
+    rules = file.readAll();
+    return true;
+}
+
+static QString filterIdentifier(const QString& name, const QByteArray& rules)
+{
+    // Identifiers are file names in the store. Changed rules get a new one
+    // so that a stale compiled filter is never picked up.
+    QString identifier;
+    for (const QChar& c : name)
+        identifier += c.isLetterOrNumber() && c.unicode() < 0x80 ? c : QLatin1Char('_');
+    return identifier + QLatin1Char('-') + QString::fromLatin1(QCryptographicHash::hash(rules, QCryptographicHash::Sha1).toHex());
+}
+
+WPEQtContentFilters::WPEQtContentFilters()
+{
+}
+
+WPEQtContentFilters::~WPEQtContentFilters()
+{
+    for (auto& pending : pendingFilters())
+        pending.waiters.removeAll(this);
+    setManager(nullptr);
+}
+
+bool WPEQtContentFilters::isBlockedByContentFilter(const GError* error)
+{
+    return g_error_matches(error, WEBKIT_POLICY_ERROR, blockedByContentFilterError);
+}
+
+void WPEQtContentFilters::resourceLoadStarted(WebKitWebResource* resource)
+{
+    // Resources can fail after the view is gone, for instance when its web
+    // process is terminated, so the handler only holds a weak reference.
+    g_signal_connect_data(resource, "failed", G_CALLBACK(resourceFailedCallback),
+        new std::weak_ptr<WPEQtContentFilters>(shared_from_this()), [](gpointer data, GClosure*) {
+            delete static_cast<std::weak_ptr<WPEQtContentFilters>*>(data);
+        }, static_cast<GConnectFlags>(0));
+}
+
+void WPEQtContentFilters::resourceFailedCallback(WebKitWebResource*, GError* error, std::weak_ptr<WPEQtContentFilters>* filters)
+{
+    auto contentFilters = filters->lock();
+    if (contentFilters && isBlockedByContentFilter(error))
+        contentFilters->noteBlockedRequest();
+}
+
+void WPEQtContentFilters::setManager(WebKitUserContentManager* manager)
+{
+    if (m_manager.get() == manager)
+        return;
+
+    if (m_manager)
+        webkit_user_content_manager_remove_all_filters(m_manager.get());
+
+    m_manager = manager;
+    if (!m_manager)
+        return;
+
+    for (auto* filter : qAsConst(m_filters)) {
+        if (filter)
+            webkit_user_content_manager_add_filter(m_manager.get(), filter);
+    }
+}
+
+void WPEQtContentFilters::setFilters(const QVariantList& entries)
+{
+    QHash<QString, QByteArray> wanted;
+    for (const auto& entry : entries) {
+        QString name;
+        QByteArray rules;
+        if (readRules(entry, name, rules))
+            wanted.insert(filterIdentifier(name, rules), rules);
+    }
+
+    for (auto it = m_filters.begin(); it != m_filters.end();) {
+        if (wanted.contains(it.key())) {
+            ++it;
+            continue;
+        }
+#if WEBKIT_CHECK_VERSION(2, 24, 0)
+        if (m_manager && it.value())
+            webkit_user_content_manager_remove_filter(m_manager.get(), it.value());
+#endif
+        it = m_filters.erase(it);
+    }
+#if !WEBKIT_CHECK_VERSION(2, 24, 0)
+    if (m_manager) {
+        webkit_user_content_manager_remove_all_filters(m_manager.get());
+        for (auto* filter : qAsConst(m_filters)) {
+            if (filter)
+                webkit_user_content_manager_add_filter(m_manager.get(), filter);
+        }
+    }
+#endif
+
+    for (auto it = wanted.cbegin(); it != wanted.cend(); ++it) {
+        if (m_filters.contains(it.key()))
+            continue;
+
+        if (auto* filter = compiledFilters().value(it.key())) {
+            m_statistics.memoryCacheHits++;
+            addFilter(it.key(), filter);
+        } else
+            requestFilter(it.key(), it.value());
+    }
+}
+
+void WPEQtContentFilters::requestFilter(const QString& identifier, const QByteArray& rules)
+{
+    m_filters.insert(identifier, nullptr);
+
+    auto& pending = pendingFilters();
+    auto it = pending.find(identifier);
+    if (it != pending.end()) {
+        if (!it->waiters.contains(this))
+            it->waiters.append(this);
+        return;
+    }
+
+    PendingFilter& filter = pending[identifier];
+    filter.rules = rules;
+    filter.waiters.append(this);
+
+    // Try the on-disk cache first, compiling only when it misses.
+    webkit_user_content_filter_store_load(filterStore(), identifier.toUtf8().constData(), nullptr,
+        filterLoadedCallback, new QString(identifier));
+}
+
+void WPEQtContentFilters::filterLoadedCallback(GObject* object, GAsyncResult* result, gpointer userData)
+{
+    std::unique_ptr<QString> identifier(static_cast<QString*>(userData));
+    GUniqueOutPtr<GError> error;
+    WebKitUserContentFilter* filter = webkit_user_content_filter_store_load_finish(WEBKIT_USER_CONTENT_FILTER_STORE(object), result, &error.outPtr());
+    if (filter) {
+        filterReady(*identifier, filter, 0, true);
+        return;
+    }
+
+    auto it = pendingFilters().find(*identifier);
+    if (it == pendingFilters().end())
+        return;
+
+    it->timer.start();
+    GBytes* rules = g_bytes_new(it->rules.constData(), it->rules.size());
+    const QByteArray identifierData = identifier->toUtf8();
+    webkit_user_content_filter_store_save(WEBKIT_USER_CONTENT_FILTER_STORE(object), identifierData.constData(), rules, nullptr,
+        filterSavedCallback, identifier.release());
+    g_bytes_unref(rules);
+}
+
+void WPEQtContentFilters::filterSavedCallback(GObject* object, GAsyncResult* result, gpointer userData)
+{
+    std::unique_ptr<QString> identifier(static_cast<QString*>(userData));
+    GUniqueOutPtr<GError> error;
+    WebKitUserContentFilter* filter = webkit_user_content_filter_store_save_finish(WEBKIT_USER_CONTENT_FILTER_STORE(object), result, &error.outPtr());
+    if (!filter)
+        qWarning("Failed to compile content filter %s: %s", qPrintable(*identifier), error->message);
+
+    auto it = pendingFilters().constFind(*identifier);
+    qint64 compileTime = it != pendingFilters().constEnd() ? it->timer.elapsed() : 0;
+    filterReady(*identifier, filter, compileTime, false);
+}
+
+void WPEQtContentFilters::filterReady(const QString& identifier, WebKitUserContentFilter* filter, qint64 compileTime, bool fromDisk)
+{
+    if (filter)
+        compiledFilters().insert(identifier, filter);
+
+    const PendingFilter pending = pendingFilters().take(identifier);
+    for (auto* waiter : pending.waiters) {
+        if (!waiter->m_filters.contains(identifier))
+            continue;
+
+        if (!filter) {
+            waiter->m_statistics.failedFilters++;
+            waiter->m_filters.remove(identifier);
+            continue;
+        }
+
+        if (fromDisk)
+            waiter->m_statistics.diskCacheHits++;
+        else {
+            waiter->m_statistics.compiledFilters++;
+            waiter->m_statistics.compileTime += compileTime;
+        }
+        waiter->addFilter(identifier, filter);
+    }
+}
+
+void WPEQtContentFilters::addFilter(const QString& identifier, WebKitUserContentFilter* filter)
+{
+    m_filters.insert(identifier, filter);
+    if (m_manager)
+        webkit_user_content_manager_add_filter(m_manager.get(), filter);
+}
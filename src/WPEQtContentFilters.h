@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <QHash>
+#include <QString>
+#include <QVariant>
+#include <memory>
+#include <wpe/webkit.h>
+#include <wtf/glib/GRefPtr.h>
+
+// Applies content blocker rule lists to a view's WebKitUserContentManager.
+// Rule lists are compiled with a process-wide WebKitUserContentFilterStore
+// whose on-disk cache survives restarts; compiled filters are also kept in
+// memory and shared by all views.
+class WPEQtContentFilters : public std::enable_shared_from_this<WPEQtContentFilters> {
+public:
+    struct Statistics {
+        unsigned compiledFilters { 0 };
+        qint64 compileTime { 0 }; // milliseconds
+        unsigned memoryCacheHits { 0 };
+        unsigned diskCacheHits { 0 };
+        unsigned failedFilters { 0 };
+        unsigned blockedRequests { 0 };
+    };
+
+    WPEQtContentFilters();
+    ~WPEQtContentFilters();
+
+    void setManager(WebKitUserContentManager*);
+    void setFilters(const QVariantList&);
+
+    // Counts the resource as blocked if it fails because of a filter.
+    void resourceLoadStarted(WebKitWebResource*);
+    void noteBlockedRequest() { m_statistics.blockedRequests++; }
+    const Statistics& statistics() const { return m_statistics; }
+
+    static bool isBlockedByContentFilter(const GError*);
+
+private:
+    static void resourceFailedCallback(WebKitWebResource*, GError*, std::weak_ptr<WPEQtContentFilters>*);
+    static void filterLoadedCallback(GObject*, GAsyncResult*, gpointer);
+    static void filterSavedCallback(GObject*, GAsyncResult*, gpointer);
+    static void filterReady(const QString& identifier, WebKitUserContentFilter*, qint64 compileTime, bool fromDisk);
+
+    void requestFilter(const QString& identifier, const QByteArray& rules);
+    void addFilter(const QString& identifier, WebKitUserContentFilter*);
+
+    GRefPtr<WebKitUserContentManager> m_manager;
+    // Identifiers of the wanted filters, with the compiled filter once ready.
+    QHash<QString, WebKitUserContentFilter*> m_filters;
+    Statistics m_statistics;
+};
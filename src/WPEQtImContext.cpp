@@ -24,15 +24,27 @@
 #include <QInputMethod>
 #include <QInputMethodEvent>
 #include <QGuiApplication>
+#include <wtf/glib/GRefPtr.h>
+
+typedef enum {
+    VisibilityUnchanged,
+    VisibilityShow,
+    VisibilityHide
+} WPEQtImContextVisibility;
 
 typedef struct {
     WPEQtView *view;
     bool enabled;
     QRect *cursorArea;
+    QByteArray *surroundingUtf8;
     QString *surroundinText;
+    bool surroundingTextValid;
     unsigned cursorIndex;
     unsigned selectionIndex;
     Qt::InputMethodHints hints;
+    Qt::InputMethodQueries pendingQueries;
+    WPEQtImContextVisibility pendingVisibility;
+    bool updateScheduled;
 } WPEQtImContextPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(WPEQtImContext, wpeqt_im_context, WEBKIT_TYPE_INPUT_METHOD_CONTEXT)
@@ -44,31 +56,80 @@ static void wpeqt_im_context_finalize(GObject *object)
     WPEQtImContextPrivate *priv = PRIV(object);
 
     delete priv->cursorArea;
+    delete priv->surroundingUtf8;
     delete priv->surroundinText;
 
     G_OBJECT_CLASS(wpeqt_im_context_parent_class)->finalize(object);
 }
 
-static void wpeqt_im_context_notify_focus_in(WebKitInputMethodContext *context)
+static void wpeqt_im_context_flush(WPEQtImContext *context)
 {
     WPEQtImContextPrivate *priv = PRIV(context);
 
-    priv->enabled = true;
+    priv->updateScheduled = false;
+
+    Qt::InputMethodQueries queries = priv->pendingQueries;
+    priv->pendingQueries = Qt::InputMethodQueries();
+    if (queries)
+        qApp->inputMethod()->update(queries);
 
-    qApp->inputMethod()->update(Qt::ImQueryInput | Qt::ImEnabled | Qt::ImHints);
-    if (!qApp->inputMethod()->isVisible() && priv->view->hasActiveFocus())
+    WPEQtImContextVisibility visibility = priv->pendingVisibility;
+    priv->pendingVisibility = VisibilityUnchanged;
+    if (!priv->view->hasActiveFocus())
+        return;
+
+    if (visibility == VisibilityShow && priv->enabled && !qApp->inputMethod()->isVisible())
         qApp->inputMethod()->setVisible(true);
+    else if (visibility == VisibilityHide && qApp->inputMethod()->isVisible())
+        qApp->inputMethod()->setVisible(false);
 }
 
-static void wpeqt_im_context_notify_focus_out(WebKitInputMethodContext *context)
+static void wpeqt_im_context_schedule_update(WebKitInputMethodContext *context, Qt::InputMethodQueries queries, WPEQtImContextVisibility visibility)
 {
     WPEQtImContextPrivate *priv = PRIV(context);
 
-    priv->enabled = false;
+    // WebKit sends several notifications for a single edit, they are merged
+    // into one input method update per event loop iteration. The cursor and
+    // surrounding text updates that follow a blur must not show the input
+    // method again.
+    priv->pendingQueries |= queries;
+    if (visibility == VisibilityHide || (visibility == VisibilityShow && priv->pendingVisibility != VisibilityHide))
+        priv->pendingVisibility = visibility;
+
+    if (priv->updateScheduled || (!priv->pendingQueries && priv->pendingVisibility == VisibilityUnchanged))
+        return;
+
+    priv->updateScheduled = true;
+    GRefPtr<WPEQtImContext> protectedContext(WPEQT_IM_CONTEXT(context));
+    QMetaObject::invokeMethod(priv->view, [protectedContext] {
+        wpeqt_im_context_flush(protectedContext.get());
+    }, Qt::QueuedConnection);
+}
 
-    qApp->inputMethod()->update(Qt::ImQueryInput | Qt::ImEnabled | Qt::ImHints);
-    if (qApp->inputMethod()->isVisible() && priv->view->hasActiveFocus())
-        qApp->inputMethod()->setVisible(false);
+static void wpeqt_im_context_set_enabled(WebKitInputMethodContext *context, bool enabled, WPEQtImContextVisibility visibility)
+{
+    WPEQtImContextPrivate *priv = PRIV(context);
+
+    Qt::InputMethodQueries queries;
+    if (priv->enabled != enabled) {
+        // The input method reads the whole state when it gets enabled.
+        priv->enabled = enabled;
+        queries = Qt::ImQueryInput | Qt::ImEnabled | Qt::ImHints;
+    }
+    // Focus moved to another field, the blur of the previous one is moot.
+    if (enabled && priv->pendingVisibility == VisibilityHide)
+        priv->pendingVisibility = VisibilityUnchanged;
+    wpeqt_im_context_schedule_update(context, queries, visibility);
+}
+
+static void wpeqt_im_context_notify_focus_in(WebKitInputMethodContext *context)
+{
+    wpeqt_im_context_set_enabled(context, true, VisibilityShow);
+}
+
+static void wpeqt_im_context_notify_focus_out(WebKitInputMethodContext *context)
+{
+    wpeqt_im_context_set_enabled(context, false, VisibilityHide);
 }
 
 static void wpeqt_im_context_notify_cursor_area(WebKitInputMethodContext *context, int x, int y, int width, int height)
@@ -77,38 +138,66 @@ static void wpeqt_im_context_notify_cursor_area(WebKitInputMethodContext *contex
 
     // XXX: There's no way to query scroll position (beside JS), and the x/y
     //      here are in content coordinates instead of in viewport coordinates.
-    *priv->cursorArea = QRect(std::min(x, (int)priv->view->width()), std::min(y, (int)priv->view->height()), width, height);
+    QRect cursorArea(std::min(x, (int)priv->view->width()), std::min(y, (int)priv->view->height()), width, height);
 
-    qApp->inputMethod()->update(Qt::ImQueryInput | Qt::ImEnabled | Qt::ImHints);
-    if (!qApp->inputMethod()->isVisible() && priv->enabled && priv->view->hasActiveFocus())
-        qApp->inputMethod()->setVisible(true);
+    Qt::InputMethodQueries queries;
+    if (*priv->cursorArea != cursorArea) {
+        *priv->cursorArea = cursorArea;
+        queries |= Qt::ImCursorRectangle;
+    }
+    wpeqt_im_context_schedule_update(context, queries, priv->enabled ? VisibilityShow : VisibilityUnchanged);
 }
 
 static void wpeqt_im_context_notify_surrounding(WebKitInputMethodContext *context, const char *text, guint length, guint cursor_index, guint selection_index)
 {
     WPEQtImContextPrivate *priv = PRIV(context);
 
-    *priv->surroundinText = QString::fromUtf8(text, length);
-    priv->cursorIndex = cursor_index;
-    priv->selectionIndex = selection_index;
-
-    qApp->inputMethod()->update(Qt::ImQueryInput | Qt::ImEnabled | Qt::ImHints);
-    if (!qApp->inputMethod()->isVisible() && priv->enabled && priv->view->hasActiveFocus())
-        qApp->inputMethod()->setVisible(true);
+    Qt::InputMethodQueries queries;
+    // The text is only decoded when the input method asks for it.
+    if (*priv->surroundingUtf8 != QByteArray::fromRawData(text, length)) {
+        *priv->surroundingUtf8 = QByteArray(text, length);
+        priv->surroundingTextValid = false;
+        queries |= Qt::ImSurroundingText;
+    }
+    if (priv->cursorIndex != cursor_index) {
+        priv->cursorIndex = cursor_index;
+        queries |= Qt::ImCursorPosition | Qt::ImCurrentSelection;
+    }
+    if (priv->selectionIndex != selection_index) {
+        priv->selectionIndex = selection_index;
+        queries |= Qt::ImAnchorPosition | Qt::ImCurrentSelection;
+    }
+    wpeqt_im_context_schedule_update(context, queries, priv->enabled ? VisibilityShow : VisibilityUnchanged);
 }
 
 static void wpeqt_im_context_reset(WebKitInputMethodContext *context)
 {
     WPEQtImContextPrivate *priv = PRIV(context);
 
-    priv->enabled = false;
-    *priv->cursorArea = QRect();
-    *priv->surroundinText = QString();
-    priv->cursorIndex = 0;
-    priv->selectionIndex = 0;
-    priv->hints = Qt::ImhNone;
-
-    qApp->inputMethod()->update(Qt::ImQueryInput | Qt::ImEnabled | Qt::ImHints);
+    Qt::InputMethodQueries queries;
+    if (priv->enabled) {
+        priv->enabled = false;
+        queries |= Qt::ImEnabled;
+    }
+    if (!priv->cursorArea->isNull()) {
+        *priv->cursorArea = QRect();
+        queries |= Qt::ImCursorRectangle;
+    }
+    if (!priv->surroundingUtf8->isEmpty()) {
+        priv->surroundingUtf8->clear();
+        priv->surroundingTextValid = false;
+        queries |= Qt::ImSurroundingText;
+    }
+    if (priv->cursorIndex || priv->selectionIndex) {
+        priv->cursorIndex = 0;
+        priv->selectionIndex = 0;
+        queries |= Qt::ImCursorPosition | Qt::ImAnchorPosition | Qt::ImCurrentSelection;
+    }
+    if (priv->hints != Qt::ImhNone) {
+        priv->hints = Qt::ImhNone;
+        queries |= Qt::ImHints;
+    }
+    wpeqt_im_context_schedule_update(context, queries, VisibilityUnchanged);
 }
 
 static void wpeqt_im_context_class_init(WPEQtImContextClass *klass)
@@ -132,26 +221,26 @@ static void wpeqt_im_context_content_type_changed(WPEQtImContext *context)
     WebKitInputPurpose purpose = webkit_input_method_context_get_input_purpose(wk_context);
     WebKitInputHints hints = webkit_input_method_context_get_input_hints(wk_context);
 
-    priv->hints = Qt::ImhNone;
+    Qt::InputMethodHints qtHints = Qt::ImhNone;
 
     switch (purpose) {
     case WEBKIT_INPUT_PURPOSE_DIGITS:
-        priv->hints = Qt::ImhDigitsOnly;
+        qtHints = Qt::ImhDigitsOnly;
         break;
     case WEBKIT_INPUT_PURPOSE_NUMBER:
-        priv->hints = Qt::ImhFormattedNumbersOnly;
+        qtHints = Qt::ImhFormattedNumbersOnly;
         break;
     case WEBKIT_INPUT_PURPOSE_PHONE:
-        priv->hints = Qt::ImhDialableCharactersOnly;
+        qtHints = Qt::ImhDialableCharactersOnly;
         break;
     case WEBKIT_INPUT_PURPOSE_URL:
-        priv->hints = Qt::ImhUrlCharactersOnly;
+        qtHints = Qt::ImhUrlCharactersOnly;
         break;
     case WEBKIT_INPUT_PURPOSE_EMAIL:
-        priv->hints = Qt::ImhEmailCharactersOnly;
+        qtHints = Qt::ImhEmailCharactersOnly;
         break;
     case WEBKIT_INPUT_PURPOSE_PASSWORD:
-        priv->hints = Qt::ImhHiddenText | Qt::ImhSensitiveData;
+        qtHints = Qt::ImhHiddenText | Qt::ImhSensitiveData;
         break;
     default:
         break;
@@ -160,14 +249,18 @@ static void wpeqt_im_context_content_type_changed(WPEQtImContext *context)
     // if (hints & WEBKIT_INPUT_HINT_NONE)
     // if (hints & WEBKIT_INPUT_HINT_SPELLCHECK)
     if (hints & WEBKIT_INPUT_HINT_LOWERCASE)
-        priv->hints |= Qt::ImhPreferLowercase;
+        qtHints |= Qt::ImhPreferLowercase;
     if (hints & WEBKIT_INPUT_HINT_UPPERCASE_CHARS)
-        priv->hints |= Qt::ImhPreferUppercase;
+        qtHints |= Qt::ImhPreferUppercase;
     if (!(hints & (WEBKIT_INPUT_HINT_UPPERCASE_WORDS | WEBKIT_INPUT_HINT_UPPERCASE_SENTENCES)))
-        priv->hints |= Qt::ImhNoAutoUppercase;
+        qtHints |= Qt::ImhNoAutoUppercase;
     // if (hints & WEBKIT_INPUT_HINT_INHIBIT_OSK)
 
-    qApp->inputMethod()->update(Qt::ImQueryInput | Qt::ImEnabled | Qt::ImHints);
+    if (priv->hints == qtHints)
+        return;
+
+    priv->hints = qtHints;
+    wpeqt_im_context_schedule_update(wk_context, Qt::ImHints, VisibilityUnchanged);
 }
 
 static void wpeqt_im_context_init(WPEQtImContext *context)
@@ -183,6 +276,7 @@ WebKitInputMethodContext *wpeqt_im_context_new(WPEQtView *view)
     WPEQtImContextPrivate *priv = PRIV(context);
     priv->view = view;
     priv->cursorArea = new QRect;
+    priv->surroundingUtf8 = new QByteArray;
     priv->surroundinText = new QString;
 
     return context;
@@ -194,6 +288,15 @@ void wpeqt_im_context_event(WPEQtImContext *context, QInputMethodEvent *event)
         g_signal_emit_by_name(WEBKIT_INPUT_METHOD_CONTEXT(context), "committed", qPrintable(event->commitString()));
 }
 
+static const QString& wpeqt_im_context_surrounding_text(WPEQtImContextPrivate *priv)
+{
+    if (!priv->surroundingTextValid) {
+        *priv->surroundinText = QString::fromUtf8(*priv->surroundingUtf8);
+        priv->surroundingTextValid = true;
+    }
+    return *priv->surroundinText;
+}
+
 void wpeqt_im_context_query(WPEQtImContext *context, Qt::InputMethodQuery query, QVariant *out)
 {
     WPEQtImContextPrivate *priv = PRIV(context);
@@ -212,8 +315,14 @@ void wpeqt_im_context_query(WPEQtImContext *context, Qt::InputMethodQuery query,
         *out = QVariant(priv->selectionIndex);
         break;
     case Qt::ImSurroundingText:
-        *out = QVariant(*priv->surroundinText);
+        *out = QVariant(wpeqt_im_context_surrounding_text(priv));
         break;
+    case Qt::ImCurrentSelection: {
+        unsigned start = std::min(priv->cursorIndex, priv->selectionIndex);
+        unsigned end = std::max(priv->cursorIndex, priv->selectionIndex);
+        *out = QVariant(wpeqt_im_context_surrounding_text(priv).mid(start, end - start));
+        break;
+    }
     case Qt::ImHints:
         *out = QVariant(priv->hints);
         break;
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtJSCValue.h"
+
+#include <QJSEngine>
+#include <QVarLengthArray>
+#include <algorithm>
+#include <wtf/glib/GRefPtr.h>
+#include <wtf/glib/GUniquePtr.h>
+
+struct ObjectPath {
+    // Objects from the root to the value being converted. A JSCContext hands
+    // out a single JSCValue per live JavaScript value, so pointers identify
+    // objects; the path keeps them alive.
+    QVarLengthArray<JSCValue*, 16> objects;
+    unsigned converted { 0 };
+};
+
+// Plain data is rarely deeper or larger than this, DOM nodes and the window
+// object reach everything else and are cut here.
+static const int maxDepth = 16;
+static const unsigned maxObjects = 10000;
+
+static QVariant toVariant(JSCValue*, ObjectPath&);
+
+#if WEBKIT_CHECK_VERSION(2, 38, 0)
+template<typename T>
+static QVariantList typedArrayToList(const void* data, gsize length)
+{
+    const T* elements = static_cast<const T*>(data);
+    QVariantList list;
+    list.reserve(static_cast<int>(length));
+    for (gsize i = 0; i < length; ++i)
+        list.append(QVariant::fromValue(elements[i]));
+    return list;
+}
+
+static QVariant typedArrayToVariant(JSCValue* value)
+{
+    gsize length = 0;
+    const void* data = jsc_value_typed_array_get_data(value, &length);
+    if (!data)
+        return QVariant();
+
+    // Byte arrays are kept as QByteArray, which QML sees as an ArrayBuffer.
+    switch (jsc_value_get_typed_array_type(value)) {
+    case JSC_TYPED_ARRAY_INT8:
+    case JSC_TYPED_ARRAY_UINT8:
+    case JSC_TYPED_ARRAY_UINT8_CLAMPED:
+        return QByteArray(static_cast<const char*>(data), static_cast<int>(length));
+    case JSC_TYPED_ARRAY_INT16:
+        return typedArrayToList<gint16>(data, length);
+    case JSC_TYPED_ARRAY_UINT16:
+        return typedArrayToList<guint16>(data, length);
+    case JSC_TYPED_ARRAY_INT32:
+        return typedArrayToList<gint32>(data, length);
+    case JSC_TYPED_ARRAY_UINT32:
+        return typedArrayToList<guint32>(data, length);
+    case JSC_TYPED_ARRAY_INT64:
+        return typedArrayToList<qint64>(data, length);
+    case JSC_TYPED_ARRAY_UINT64:
+        return typedArrayToList<quint64>(data, length);
+    case JSC_TYPED_ARRAY_FLOAT32:
+        return typedArrayToList<float>(data, length);
+    case JSC_TYPED_ARRAY_FLOAT64:
+        return typedArrayToList<double>(data, length);
+    default:
+        return QVariant();
+    }
+}
+#endif
+
+static QVariant arrayToVariant(JSCValue* value, ObjectPath& path)
+{
+    GRefPtr<JSCValue> lengthValue = adoptGRef(jsc_value_object_get_property(value, "length"));
+    int length = jsc_value_to_int32(lengthValue.get());
+
+    QVariantList list;
+    list.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        GRefPtr<JSCValue> item = adoptGRef(jsc_value_object_get_property_at_index(value, i));
+        list.append(toVariant(item.get(), path));
+    }
+    return list;
+}
+
+static QVariant objectToVariant(JSCValue* value, ObjectPath& path)
+{
+    QVariantMap map;
+    GUniquePtr<char*> properties(jsc_value_object_enumerate_properties(value));
+    if (!properties)
+        return map;
+
+    for (char** property = properties.get(); *property; ++property) {
+        GRefPtr<JSCValue> item = adoptGRef(jsc_value_object_get_property(value, *property));
+        if (jsc_value_is_function(item.get()))
+            continue;
+        map.insert(QString::fromUtf8(*property), toVariant(item.get(), path));
+    }
+    return map;
+}
+
+static QVariant containerToVariant(JSCValue* value, ObjectPath& path)
+{
+    // Cycles and objects past the limits become null.
+    auto& objects = path.objects;
+    if (objects.size() >= maxDepth || ++path.converted > maxObjects || std::find(objects.cbegin(), objects.cend(), value) != objects.cend())
+        return QVariant::fromValue(nullptr);
+
+    objects.append(value);
+    QVariant variant = jsc_value_is_array(value) ? arrayToVariant(value, path) : objectToVariant(value, path);
+    objects.removeLast();
+    return variant;
+}
+
+static QVariant toVariant(JSCValue* value, ObjectPath& path)
+{
+    if (!value || jsc_value_is_undefined(value))
+        return QVariant();
+
+    if (jsc_value_is_null(value))
+        return QVariant::fromValue(nullptr);
+
+    if (jsc_value_is_boolean(value))
+        return QVariant(static_cast<bool>(jsc_value_to_boolean(value)));
+
+    if (jsc_value_is_number(value))
+        return QVariant(jsc_value_to_double(value));
+
+    if (jsc_value_is_string(value)) {
+        GUniquePtr<char> string(jsc_value_to_string(value));
+        return QString::fromUtf8(string.get());
+    }
+
+#if WEBKIT_CHECK_VERSION(2, 38, 0)
+    if (jsc_value_is_typed_array(value))
+        return typedArrayToVariant(value);
+
+    if (jsc_value_is_array_buffer(value)) {
+        gsize size = 0;
+        const void* data = jsc_value_array_buffer_get_data(value, &size);
+        return QByteArray(static_cast<const char*>(data), static_cast<int>(size));
+    }
+#endif
+
+    if (jsc_value_is_function(value))
+        return QVariant();
+
+    if (jsc_value_is_array(value) || jsc_value_is_object(value))
+        return containerToVariant(value, path);
+
+    return QVariant();
+}
+
+// Converts a JavaScript value to a QVariant without going through JSON:
+// numbers, booleans, strings, arrays, plain objects and typed arrays are
+// supported, functions are skipped and cycles become null. Exceptions raised while reading
+// properties are reported and cleared.
+QVariant jscValueToVariant(JSCValue* value)
+{
+    ObjectPath path;
+    QVariant variant = toVariant(value, path);
+
+    if (value) {
+        JSCContext* context = jsc_value_get_context(value);
+        if (JSCException* exception = jsc_context_get_exception(context)) {
+            qWarning("Error converting JavaScript value: %s", jsc_exception_get_message(exception));
+            jsc_context_clear_exception(context);
+        }
+    }
+
+    return variant;
+}
+
+QJSValue jscValueToJSValue(QJSEngine* engine, JSCValue* value)
+{
+    return engine->toScriptValue(jscValueToVariant(value));
+}
@@ -20,23 +20,11 @@
 
 #pragma once
 
-#include "WPEQtView.h"
-#include <QtCore/qstring.h>
-#include <QtCore/qurl.h>
+#include <QJSValue>
+#include <QVariant>
+#include <wpe/webkit.h>
 
-class WPEQtViewLoadRequestPrivate {
-public:
-    WPEQtViewLoadRequestPrivate() { }
-    WPEQtViewLoadRequestPrivate(const QUrl& url, WPEQtView::LoadStatus status, const QString& errorString)
-        : m_url(url)
-        , m_status(status)
-        , m_errorString(errorString)
-    { }
-    ~WPEQtViewLoadRequestPrivate() { }
+class QJSEngine;
 
-    QUrl m_url;
-    WPEQtView::LoadStatus m_status;
-    QString m_errorString;
-};
-
-Q_DECLARE_METATYPE(WPEQtViewLoadRequestPrivate)
+QVariant jscValueToVariant(JSCValue*);
+QJSValue jscValueToJSValue(QJSEngine*, JSCValue*);
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtMainContext.h"
+
+#include "WPEQtWebKitThread.h"
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QHash>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <glib.h>
+#include <memory>
+
+static WPEQtMainContext::Integration s_integration = WPEQtMainContext::QtGlibDispatcher;
+static GMainContext* s_context = nullptr;
+static unsigned s_views = 0;
+
+// A source meant to be dispatched at a given time, how late it actually is
+// tells how long the context waited for its loop.
+namespace DispatchProbe {
+
+static const gint64 interval = 100 * G_TIME_SPAN_MILLISECOND;
+static const gint64 stallThreshold = 50 * G_TIME_SPAN_MILLISECOND;
+static const gint64 warningThreshold = G_TIME_SPAN_SECOND;
+
+static std::atomic<quint64> probes { 0 };
+static std::atomic<qint64> totalLatency { 0 };
+static std::atomic<qint64> maxLatency { 0 };
+static std::atomic<quint64> stalls { 0 };
+static bool warned = false;
+static GSource* source = nullptr;
+
+static void record(gint64 latency)
+{
+    // Only the thread iterating the context records, no need for a CAS loop.
+    probes.fetch_add(1, std::memory_order_relaxed);
+    totalLatency.fetch_add(latency, std::memory_order_relaxed);
+    if (latency > maxLatency.load(std::memory_order_relaxed))
+        maxLatency.store(latency, std::memory_order_relaxed);
+    if (latency < stallThreshold)
+        return;
+
+    stalls.fetch_add(1, std::memory_order_relaxed);
+    if (!warned && latency >= warningThreshold) {
+        warned = true;
+        qWarning("The GLib main context used by WebKit was not dispatched for %" G_GINT64_FORMAT " ms, "
+            "further stalls are counted in WPEView.eventLoopStatistics()", latency / G_TIME_SPAN_MILLISECOND);
+    }
+}
+
+static void attach(GMainContext* context)
+{
+    static GSourceFuncs sourceFuncs = {
+        nullptr, // prepare
+        nullptr, // check
+        // dispatch
+        [](GSource* source, GSourceFunc, gpointer) -> gboolean
+        {
+            gint64 now = g_get_monotonic_time();
+            record(now - g_source_get_ready_time(source));
+            g_source_set_ready_time(source, now + interval);
+            return G_SOURCE_CONTINUE;
+        },
+        nullptr, // finalize
+        nullptr, // closure_callback
+        nullptr, // closure_marshall
+    };
+
+    source = g_source_new(&sourceFuncs, sizeof(GSource));
+    g_source_set_name(source, "[WPEQt] Dispatch latency probe");
+    // Same priority as WebKit's own run loop sources.
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_ready_time(source, g_get_monotonic_time() + interval);
+    g_source_attach(source, context);
+}
+
+static void detach()
+{
+    g_source_destroy(source);
+    g_source_unref(source);
+    source = nullptr;
+}
+
+} // namespace DispatchProbe
+
+// Iterates a GLib main context from the Qt event loop: prepare and query
+// the context, wait for its file descriptors or timeout with the Qt event
+// loop, then check and dispatch it. Activations during one event loop
+// iteration result in a single dispatch.
+class MainContextPump {
+public:
+    explicit MainContextPump(GMainContext*);
+
+private:
+    struct Notifiers {
+        std::unique_ptr<QSocketNotifier> read;
+        std::unique_ptr<QSocketNotifier> write;
+    };
+
+    void prepare();
+    void dispatch();
+    void updateNotifiers();
+    void updateNotifier(std::unique_ptr<QSocketNotifier>&, int fd, QSocketNotifier::Type, bool wanted);
+
+    GMainContext* m_context;
+    gint m_priority { 0 };
+    QVector<GPollFD> m_fds;
+    int m_fdCount { 0 };
+    QHash<int, Notifiers> m_notifiers;
+    QTimer m_timer;
+};
+
+MainContextPump::MainContextPump(GMainContext* context)
+    : m_context(context)
+    , m_fds(8)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&m_timer, &QTimer::timeout, [this] {
+        dispatch();
+    });
+
+    prepare();
+}
+
+void MainContextPump::prepare()
+{
+    gint timeout;
+    bool ready = g_main_context_prepare(m_context, &m_priority);
+    while ((m_fdCount = g_main_context_query(m_context, m_priority, &timeout, m_fds.data(), m_fds.size())) > m_fds.size())
+        m_fds.resize(m_fdCount);
+
+    updateNotifiers();
+    if (ready)
+        m_timer.start(0);
+    else if (timeout >= 0)
+        m_timer.start(timeout);
+    else
+        m_timer.stop();
+}
+
+void MainContextPump::dispatch()
+{
+    // Notifiers only tell which descriptor woke us up, poll them all.
+    g_poll(m_fds.data(), m_fdCount, 0);
+    if (g_main_context_check(m_context, m_priority, m_fds.data(), m_fdCount))
+        g_main_context_dispatch(m_context);
+
+    prepare();
+}
+
+void MainContextPump::updateNotifier(std::unique_ptr<QSocketNotifier>& notifier, int fd, QSocketNotifier::Type type, bool wanted)
+{
+    if (!wanted) {
+        notifier = nullptr;
+        return;
+    }
+
+    if (!notifier) {
+        notifier = std::make_unique<QSocketNotifier>(fd, type);
+        QObject::connect(notifier.get(), &QSocketNotifier::activated, &m_timer, [this, socketNotifier = notifier.get()] {
+            // Descriptors stay ready until dispatched, mute them until then.
+            socketNotifier->setEnabled(false);
+            m_timer.start(0);
+        });
+    }
+    notifier->setEnabled(true);
+}
+
+void MainContextPump::updateNotifiers()
+{
+    QHash<int, gushort> events;
+    for (int i = 0; i < m_fdCount; ++i)
+        events[m_fds[i].fd] |= m_fds[i].events;
+
+    for (auto it = m_notifiers.begin(); it != m_notifiers.end();) {
+        if (!events.contains(it.key()))
+            it = m_notifiers.erase(it);
+        else
+            ++it;
+    }
+
+    for (auto it = events.cbegin(); it != events.cend(); ++it) {
+        auto& notifiers = m_notifiers[it.key()];
+        updateNotifier(notifiers.read, it.key(), QSocketNotifier::Read, it.value() & (G_IO_IN | G_IO_PRI | G_IO_HUP | G_IO_ERR));
+        updateNotifier(notifiers.write, it.key(), QSocketNotifier::Write, it.value() & G_IO_OUT);
+    }
+}
+
+void WPEQtMainContext::initialize()
+{
+    static bool initialized = false;
+    if (initialized || !QCoreApplication::instance())
+        return;
+    initialized = true;
+
+    if (auto* thread = WPEQtWebKitThread::instance()) {
+        s_integration = WebKitThread;
+        s_context = thread->context();
+        return;
+    }
+
+    s_context = g_main_context_default();
+
+    // Qt's GLib dispatcher iterates the default context of the GUI thread.
+    auto* dispatcher = QAbstractEventDispatcher::instance(QCoreApplication::instance()->thread());
+    if (dispatcher && dispatcher->inherits("QEventDispatcherGlib"))
+        return;
+
+    if (!g_main_context_acquire(g_main_context_default())) {
+        qWarning("The GLib main context is owned by another thread, WebKit will not be able to run");
+        return;
+    }
+
+    qWarning("Qt is not using its GLib event dispatcher (%s), the GLib main context is pumped from the Qt event loop",
+        dispatcher ? dispatcher->metaObject()->className() : "none");
+    s_integration = QtEventLoopPump;
+    // Lives as long as the application, like WebKit's main run loop.
+    new MainContextPump(g_main_context_default());
+}
+
+void WPEQtMainContext::viewCreated()
+{
+    if (!s_views++ && s_context)
+        DispatchProbe::attach(s_context);
+}
+
+void WPEQtMainContext::viewDestroyed()
+{
+    if (!--s_views && DispatchProbe::source)
+        DispatchProbe::detach();
+}
+
+WPEQtMainContext::Integration WPEQtMainContext::integration()
+{
+    return s_integration;
+}
+
+QVariantMap WPEQtMainContext::statistics()
+{
+    static const char* integrationNames[] = { "qtGlibDispatcher", "qtEventLoopPump", "webKitThread" };
+
+    const quint64 probes = DispatchProbe::probes.load(std::memory_order_relaxed);
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("integration"), QString::fromLatin1(integrationNames[s_integration]));
+    statistics.insert(QStringLiteral("probes"), probes);
+    statistics.insert(QStringLiteral("averageLatency"), probes ? DispatchProbe::totalLatency.load(std::memory_order_relaxed) / qint64(probes) : 0);
+    statistics.insert(QStringLiteral("maxLatency"), DispatchProbe::maxLatency.load(std::memory_order_relaxed));
+    statistics.insert(QStringLiteral("stalls"), DispatchProbe::stalls.load(std::memory_order_relaxed));
+    return statistics;
+}
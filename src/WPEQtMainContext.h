@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <QVariantMap>
+
+// Keeps the GLib main context used by WebKit running and watches how late
+// its sources get dispatched.
+//
+// WebKit's main run loop is the default GLib main context, which Qt only
+// iterates with its GLib event dispatcher. When the application runs with
+// another dispatcher, for example with QT_NO_GLIB set, the context is pumped
+// from the Qt event loop instead: its file descriptors are watched with
+// socket notifiers and its timeouts with a timer. With a WebKit thread the
+// context has a loop of its own and only the latency is watched. The latency
+// is only sampled while views exist, so that an idle application is not
+// woken up for it.
+class WPEQtMainContext {
+public:
+    enum Integration {
+        QtGlibDispatcher,
+        QtEventLoopPump,
+        WebKitThread
+    };
+
+    static void initialize();
+    static void viewCreated();
+    static void viewDestroyed();
+    static Integration integration();
+    static QVariantMap statistics();
+};
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtPrefetchHints.h"
+
+#include <algorithm>
+
+static const qint64 pendingHintTimeout = 5 * 60 * 1000;
+static const int maxPendingHints = 1024;
+
+QString WPEQtPrefetchHints::key(Type type, const QUrl& url)
+{
+    switch (type) {
+    case DnsPrefetch:
+        return url.host().toLower();
+    case Preconnect:
+        return url.adjusted(QUrl::RemovePath | QUrl::RemoveQuery | QUrl::RemoveFragment | QUrl::RemoveUserInfo).toString();
+    case Prefetch:
+    case TypeCount:
+        break;
+    }
+    return url.adjusted(QUrl::RemoveFragment).toString();
+}
+
+void WPEQtPrefetchHints::expirePendingHints()
+{
+    const qint64 now = m_clock.elapsed();
+    for (auto& pending : m_pending) {
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (now - it.value() > pendingHintTimeout)
+                it = pending.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+bool WPEQtPrefetchHints::add(Type type, const QUrl& url)
+{
+    const QString hint = key(type, url);
+    if (hint.isEmpty())
+        return false;
+
+    if (!m_clock.isValid())
+        m_clock.start();
+    expirePendingHints();
+
+    auto& pending = m_pending[type];
+    auto it = pending.find(hint);
+    if (it != pending.end()) {
+        // Repeated, the hint is given again but counted once.
+        it.value() = m_clock.elapsed();
+        return true;
+    }
+
+    if (pending.size() >= maxPendingHints)
+        pending.erase(std::min_element(pending.begin(), pending.end()));
+    pending.insert(hint, m_clock.elapsed());
+    m_hints[type]++;
+    return true;
+}
+
+void WPEQtPrefetchHints::navigationStarted(const QUrl& url)
+{
+    // A navigation uses every pending hint that covers it, each hint is
+    // counted once.
+    m_hintedNavigation = false;
+    if (m_clock.isValid())
+        expirePendingHints();
+    for (int type = 0; type < TypeCount; ++type) {
+        if (m_pending[type].remove(key(static_cast<Type>(type), url))) {
+            m_usedHints[type]++;
+            m_hintedNavigation = true;
+        }
+    }
+    m_navigationTimer.start();
+}
+
+void WPEQtPrefetchHints::navigationFinished(bool succeeded)
+{
+    if (!m_navigationTimer.isValid())
+        return;
+
+    if (succeeded) {
+        const qint64 loadTime = m_navigationTimer.elapsed();
+        if (m_hintedNavigation) {
+            m_hintedLoads++;
+            m_hintedLoadTime += loadTime;
+        } else {
+            m_unhintedLoads++;
+            m_unhintedLoadTime += loadTime;
+        }
+    }
+    m_navigationTimer.invalidate();
+}
+
+QVariantMap WPEQtPrefetchHints::statistics() const
+{
+    static const char* const names[TypeCount] = { "dnsPrefetch", "preconnect", "prefetch" };
+
+    QVariantMap statistics;
+    for (int type = 0; type < TypeCount; ++type) {
+        QVariantMap hints;
+        hints.insert(QStringLiteral("hints"), m_hints[type]);
+        hints.insert(QStringLiteral("used"), m_usedHints[type]);
+        hints.insert(QStringLiteral("hitRate"), m_hints[type] ? static_cast<double>(m_usedHints[type]) / m_hints[type] : 0.0);
+        hints.insert(QStringLiteral("pending"), m_pending[type].size());
+        statistics.insert(QString::fromLatin1(names[type]), hints);
+    }
+    statistics.insert(QStringLiteral("hintedLoads"), m_hintedLoads);
+    statistics.insert(QStringLiteral("averageHintedLoadTime"), m_hintedLoads ? m_hintedLoadTime / m_hintedLoads : 0);
+    statistics.insert(QStringLiteral("unhintedLoads"), m_unhintedLoads);
+    statistics.insert(QStringLiteral("averageUnhintedLoadTime"), m_unhintedLoads ? m_unhintedLoadTime / m_unhintedLoads : 0);
+    return statistics;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+#include <QUrl>
+#include <QVariant>
+
+// Keeps track of the prefetch hints given to a view, to measure how many of
+// them are followed by a navigation and how fast those navigations are.
+class WPEQtPrefetchHints {
+public:
+    enum Type {
+        DnsPrefetch,
+        Preconnect,
+        Prefetch,
+        TypeCount
+    };
+
+    // Returns false if the URL can not be used for that type of hint. Hints
+    // are always to be given to WebKit, an identical pending one is only not
+    // counted twice.
+    bool add(Type, const QUrl&);
+
+    void navigationStarted(const QUrl&);
+    void navigationFinished(bool succeeded);
+
+    QVariantMap statistics() const;
+
+private:
+    static QString key(Type, const QUrl&);
+    void expirePendingHints();
+
+    // Hints not followed by a navigation in time are dropped, by then their
+    // DNS entry or connection is likely gone.
+    QHash<QString, qint64> m_pending[TypeCount];
+    QElapsedTimer m_clock;
+    unsigned m_hints[TypeCount] { };
+    unsigned m_usedHints[TypeCount] { };
+
+    QElapsedTimer m_navigationTimer;
+    bool m_hintedNavigation { false };
+    unsigned m_hintedLoads { 0 };
+    unsigned m_unhintedLoads { 0 };
+    qint64 m_hintedLoadTime { 0 };
+    qint64 m_unhintedLoadTime { 0 };
+};
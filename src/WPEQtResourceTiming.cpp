@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtResourceTiming.h"
+
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+namespace {
+
+// Accounts the time spent recording, to check the cost of leaving the
+// capture enabled.
+class OverheadScope {
+public:
+    OverheadScope(qint64& overhead, quint64& callbacks)
+        : m_overhead(overhead)
+    {
+        callbacks++;
+        m_timer.start();
+    }
+
+    ~OverheadScope()
+    {
+        m_overhead += m_timer.nsecsElapsed();
+    }
+
+private:
+    qint64& m_overhead;
+    QElapsedTimer m_timer;
+};
+
+}
+
+static double milliseconds(qint64 nanoseconds)
+{
+    return nanoseconds / 1000000.0;
+}
+
+WPEQtResourceTiming::WPEQtResourceTiming(int capacity)
+    : m_entries(std::max(capacity, 1))
+{
+    m_clock.start();
+}
+
+WPEQtResourceTiming::Entry* WPEQtResourceTiming::entry(quint64 id)
+{
+    Entry& entry = m_entries[id % m_entries.size()];
+    return entry.id == id ? &entry : nullptr;
+}
+
+void WPEQtResourceTiming::resourceLoadStarted(WebKitWebResource* resource, WebKitURIRequest* request, bool mainResource)
+{
+    OverheadScope scope(m_overhead, m_callbacks);
+
+    const quint64 id = m_nextId++;
+    if (mainResource)
+        m_pageStartId = id;
+
+    Entry& entry = m_entries[id % m_entries.size()];
+    if (entry.id >= m_pageStartId)
+        m_droppedEntries++;
+
+    entry = Entry();
+    entry.id = id;
+    entry.url = QString::fromUtf8(webkit_uri_request_get_uri(request));
+    entry.method = webkit_uri_request_get_http_method(request);
+    if (entry.method.isEmpty())
+        entry.method = "GET";
+    entry.startedDateTime = QDateTime::currentMSecsSinceEpoch();
+    entry.start = m_clock.nsecsElapsed();
+
+    auto* data = new ResourceData { shared_from_this(), id };
+    g_object_set_data_full(G_OBJECT(resource), "wpeqt-resource-timing", data, [](gpointer data) {
+        delete static_cast<ResourceData*>(data);
+    });
+    g_signal_connect(resource, "sent-request", G_CALLBACK(sentRequestCallback), data);
+    g_signal_connect(resource, "received-data", G_CALLBACK(receivedDataCallback), data);
+    g_signal_connect(resource, "notify::response", G_CALLBACK(responseChangedCallback), data);
+    g_signal_connect(resource, "finished", G_CALLBACK(finishedCallback), data);
+    g_signal_connect(resource, "failed", G_CALLBACK(failedCallback), data);
+}
+
+void WPEQtResourceTiming::sentRequestCallback(WebKitWebResource*, WebKitURIRequest* request, WebKitURIResponse* redirectedResponse, ResourceData* data)
+{
+    auto timing = data->timing.lock();
+    if (!timing || !redirectedResponse)
+        return;
+
+    OverheadScope scope(timing->m_overhead, timing->m_callbacks);
+    if (auto* entry = timing->entry(data->id)) {
+        entry->url = QString::fromUtf8(webkit_uri_request_get_uri(request));
+        entry->redirects++;
+    }
+}
+
+void WPEQtResourceTiming::receivedDataCallback(WebKitWebResource*, guint64 length, ResourceData* data)
+{
+    auto timing = data->timing.lock();
+    if (!timing)
+        return;
+
+    OverheadScope scope(timing->m_overhead, timing->m_callbacks);
+    if (auto* entry = timing->entry(data->id))
+        entry->size += length;
+}
+
+void WPEQtResourceTiming::responseChangedCallback(WebKitWebResource* resource, GParamSpec*, ResourceData* data)
+{
+    auto timing = data->timing.lock();
+    if (!timing)
+        return;
+
+    OverheadScope scope(timing->m_overhead, timing->m_callbacks);
+    auto* entry = timing->entry(data->id);
+    WebKitURIResponse* response = webkit_web_resource_get_response(resource);
+    if (!entry || !response)
+        return;
+
+    if (entry->responseStart < 0)
+        entry->responseStart = timing->m_clock.nsecsElapsed();
+    entry->status = webkit_uri_response_get_status_code(response);
+    entry->mimeType = QString::fromUtf8(webkit_uri_response_get_mime_type(response));
+}
+
+void WPEQtResourceTiming::finishedCallback(WebKitWebResource*, ResourceData* data)
+{
+    auto timing = data->timing.lock();
+    if (!timing)
+        return;
+
+    OverheadScope scope(timing->m_overhead, timing->m_callbacks);
+    if (auto* entry = timing->entry(data->id))
+        entry->end = timing->m_clock.nsecsElapsed();
+}
+
+void WPEQtResourceTiming::failedCallback(WebKitWebResource*, GError* error, ResourceData* data)
+{
+    auto timing = data->timing.lock();
+    if (!timing)
+        return;
+
+    OverheadScope scope(timing->m_overhead, timing->m_callbacks);
+    if (auto* entry = timing->entry(data->id)) {
+        entry->end = timing->m_clock.nsecsElapsed();
+        entry->error = QString::fromUtf8(error->message);
+    }
+}
+
+QByteArray WPEQtResourceTiming::toHar(const QString& pageTitle) const
+{
+    const quint64 capacity = m_entries.size();
+    const quint64 first = std::max(m_pageStartId, m_nextId > capacity ? m_nextId - capacity : 1);
+
+    QJsonArray entries;
+    qint64 pageStartedDateTime = -1;
+    double pageLoadTime = -1;
+    for (quint64 id = first; id < m_nextId; ++id) {
+        const Entry& entry = m_entries[id % capacity];
+        if (entry.id != id)
+            continue;
+
+        const double wait = entry.responseStart >= 0 ? milliseconds(entry.responseStart - entry.start) : 0;
+        const double receive = entry.responseStart >= 0 && entry.end >= 0 ? milliseconds(entry.end - entry.responseStart) : 0;
+        if (pageStartedDateTime < 0)
+            pageStartedDateTime = entry.startedDateTime;
+        if (entry.end >= 0)
+            pageLoadTime = std::max(pageLoadTime, double(entry.startedDateTime - pageStartedDateTime) + milliseconds(entry.end - entry.start));
+
+        const QJsonObject request {
+            { QStringLiteral("method"), QString::fromLatin1(entry.method) },
+            { QStringLiteral("url"), entry.url },
+            { QStringLiteral("httpVersion"), QString() },
+            { QStringLiteral("cookies"), QJsonArray() },
+            { QStringLiteral("headers"), QJsonArray() },
+            { QStringLiteral("queryString"), QJsonArray() },
+            { QStringLiteral("headersSize"), -1 },
+            { QStringLiteral("bodySize"), -1 }
+        };
+        QJsonObject response {
+            { QStringLiteral("status"), entry.status },
+            { QStringLiteral("statusText"), QString() },
+            { QStringLiteral("httpVersion"), QString() },
+            { QStringLiteral("cookies"), QJsonArray() },
+            { QStringLiteral("headers"), QJsonArray() },
+            { QStringLiteral("content"), QJsonObject { { QStringLiteral("size"), double(entry.size) }, { QStringLiteral("mimeType"), entry.mimeType } } },
+            { QStringLiteral("redirectURL"), QString() },
+            { QStringLiteral("headersSize"), -1 },
+            { QStringLiteral("bodySize"), double(entry.size) }
+        };
+        if (!entry.error.isEmpty())
+            response.insert(QStringLiteral("_error"), entry.error);
+        const QJsonObject timings {
+            { QStringLiteral("blocked"), -1 },
+            { QStringLiteral("dns"), -1 },
+            { QStringLiteral("connect"), -1 },
+            { QStringLiteral("ssl"), -1 },
+            { QStringLiteral("send"), 0 },
+            { QStringLiteral("wait"), wait },
+            { QStringLiteral("receive"), receive }
+        };
+
+        entries.append(QJsonObject {
+            { QStringLiteral("pageref"), QStringLiteral("page_1") },
+            { QStringLiteral("startedDateTime"), QDateTime::fromMSecsSinceEpoch(entry.startedDateTime).toUTC().toString(Qt::ISODateWithMs) },
+            { QStringLiteral("time"), wait + receive },
+            { QStringLiteral("request"), request },
+            { QStringLiteral("response"), response },
+            { QStringLiteral("cache"), QJsonObject() },
+            { QStringLiteral("timings"), timings },
+            { QStringLiteral("_redirects"), int(entry.redirects) }
+        });
+    }
+
+    QJsonArray pages;
+    if (pageStartedDateTime >= 0) {
+        pages.append(QJsonObject {
+            { QStringLiteral("id"), QStringLiteral("page_1") },
+            { QStringLiteral("title"), pageTitle },
+            { QStringLiteral("startedDateTime"), QDateTime::fromMSecsSinceEpoch(pageStartedDateTime).toUTC().toString(Qt::ISODateWithMs) },
+            { QStringLiteral("pageTimings"), QJsonObject { { QStringLiteral("onContentLoad"), -1 }, { QStringLiteral("onLoad"), pageLoadTime } } }
+        });
+    }
+
+    const QJsonObject log {
+        { QStringLiteral("version"), QStringLiteral("1.2") },
+        { QStringLiteral("creator"), QJsonObject { { QStringLiteral("name"), QStringLiteral("WPEQt") }, { QStringLiteral("version"), QStringLiteral("0.1") } } },
+        { QStringLiteral("pages"), pages },
+        { QStringLiteral("entries"), entries }
+    };
+    return QJsonDocument(QJsonObject { { QStringLiteral("log"), log } }).toJson();
+}
+
+QVariantMap WPEQtResourceTiming::statistics() const
+{
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("capacity"), m_entries.size());
+    statistics.insert(QStringLiteral("resources"), m_nextId - 1);
+    statistics.insert(QStringLiteral("droppedEntries"), m_droppedEntries);
+    statistics.insert(QStringLiteral("callbacks"), m_callbacks);
+    statistics.insert(QStringLiteral("overhead"), m_overhead / 1000);
+    statistics.insert(QStringLiteral("averageOverhead"), m_callbacks ? double(m_overhead) / m_callbacks / 1000 : 0.0);
+    return statistics;
+}
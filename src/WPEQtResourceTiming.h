@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+#include <memory>
+#include <wpe/webkit.h>
+
+// Records the timing, status, type and size of the resources loaded by a
+// view in a fixed size ring, and exports the current page as HAR. Resources
+// only keep a weak reference to the recorder, they can outlive it.
+class WPEQtResourceTiming : public std::enable_shared_from_this<WPEQtResourceTiming> {
+public:
+    explicit WPEQtResourceTiming(int capacity = 1024);
+
+    void resourceLoadStarted(WebKitWebResource*, WebKitURIRequest*, bool mainResource);
+
+    QByteArray toHar(const QString& pageTitle) const;
+    QVariantMap statistics() const;
+
+private:
+    struct Entry {
+        quint64 id { 0 };
+        QString url;
+        QByteArray method;
+        qint64 startedDateTime { 0 }; // milliseconds since the epoch
+        qint64 start { 0 }; // nanoseconds on m_clock
+        qint64 responseStart { -1 };
+        qint64 end { -1 };
+        int status { 0 };
+        QString mimeType;
+        quint64 size { 0 };
+        unsigned redirects { 0 };
+        QString error;
+    };
+
+    struct ResourceData {
+        std::weak_ptr<WPEQtResourceTiming> timing;
+        quint64 id;
+    };
+
+    static void sentRequestCallback(WebKitWebResource*, WebKitURIRequest*, WebKitURIResponse*, ResourceData*);
+    static void receivedDataCallback(WebKitWebResource*, guint64, ResourceData*);
+    static void responseChangedCallback(WebKitWebResource*, GParamSpec*, ResourceData*);
+    static void finishedCallback(WebKitWebResource*, ResourceData*);
+    static void failedCallback(WebKitWebResource*, GError*, ResourceData*);
+
+    Entry* entry(quint64 id);
+
+    QVector<Entry> m_entries;
+    quint64 m_nextId { 1 };
+    quint64 m_pageStartId { 1 };
+    quint64 m_droppedEntries { 0 };
+    QElapsedTimer m_clock;
+    qint64 m_overhead { 0 };
+    quint64 m_callbacks { 0 };
+};
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtSchemeHandler.h"
+
+#include "WPEQtWebKitThread.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMimeDatabase>
+#include <QResource>
+#include <QSet>
+#include <QUrl>
+#include <wtf/glib/GRefPtr.h>
+#include <wtf/glib/GUniquePtr.h>
+
+static QHash<QString, WPEQtSchemeHandler*>& schemeHandlers()
+{
+    static QHash<QString, WPEQtSchemeHandler*> handlers {
+        { QStringLiteral("qrc"), new WPEQtResourceSchemeHandler }
+    };
+    return handlers;
+}
+
+// Schemes already registered in each web context.
+static QHash<WebKitWebContext*, QSet<QString>>& attachedContexts()
+{
+    static QHash<WebKitWebContext*, QSet<QString>> contexts;
+    return contexts;
+}
+
+void WPEQtSchemeHandler::registerHandler(const QString& scheme, std::unique_ptr<WPEQtSchemeHandler>&& handler)
+{
+    // Handlers are looked up on the thread running WebKit.
+    WPEQtWebKitThread::invoke([scheme, handler = handler.release()] {
+        auto& handlers = schemeHandlers();
+        // Contexts look the handler up by scheme on every request, so the
+        // previous one is not referenced anywhere else.
+        delete handlers.take(scheme);
+        handlers.insert(scheme, handler);
+
+        const auto contexts = attachedContexts().keys();
+        for (auto* context : contexts)
+            attachContext(context);
+    });
+}
+
+void WPEQtSchemeHandler::attachContext(WebKitWebContext* context)
+{
+    auto& contexts = attachedContexts();
+    if (!contexts.contains(context)) {
+        g_object_weak_ref(G_OBJECT(context), [](gpointer, GObject* object) {
+            attachedContexts().remove(reinterpret_cast<WebKitWebContext*>(object));
+        }, nullptr);
+    }
+
+    auto& schemes = contexts[context];
+    auto* securityManager = webkit_web_context_get_security_manager(context);
+    const auto& handlers = schemeHandlers();
+    for (auto it = handlers.cbegin(); it != handlers.cend(); ++it) {
+        if (schemes.contains(it.key()))
+            continue;
+
+        const QByteArray scheme = it.key().toLatin1();
+        webkit_web_context_register_uri_scheme(context, scheme.constData(), requestCallback, nullptr, nullptr);
+        // Bundled content is trusted, and its pages can fetch each other.
+        webkit_security_manager_register_uri_scheme_as_secure(securityManager, scheme.constData());
+        webkit_security_manager_register_uri_scheme_as_cors_enabled(securityManager, scheme.constData());
+        schemes.insert(it.key());
+    }
+}
+
+void WPEQtSchemeHandler::requestCallback(WebKitURISchemeRequest* request, gpointer)
+{
+    auto* handler = schemeHandlers().value(QString::fromLatin1(webkit_uri_scheme_request_get_scheme(request)));
+    if (!handler) {
+        finishWithError(request, QStringLiteral("Unknown URI scheme"));
+        return;
+    }
+
+    handler->handleRequest(request);
+}
+
+QString WPEQtSchemeHandler::requestPath(WebKitURISchemeRequest* request)
+{
+    return QUrl(QString::fromUtf8(webkit_uri_scheme_request_get_uri(request))).path();
+}
+
+QString WPEQtSchemeHandler::mimeTypeForPath(const QString& path)
+{
+    static const QMimeDatabase database;
+    return database.mimeTypeForFile(path, QMimeDatabase::MatchExtension).name();
+}
+
+void WPEQtSchemeHandler::finish(WebKitURISchemeRequest* request, GBytes* bytes, const QString& mimeType)
+{
+    auto stream = adoptGRef(g_memory_input_stream_new_from_bytes(bytes));
+    finish(request, stream.get(), g_bytes_get_size(bytes), mimeType);
+    g_bytes_unref(bytes);
+}
+
+void WPEQtSchemeHandler::finish(WebKitURISchemeRequest* request, GInputStream* stream, gint64 length, const QString& mimeType)
+{
+    webkit_uri_scheme_request_finish(request, stream, length, mimeType.toLatin1().constData());
+}
+
+void WPEQtSchemeHandler::finishWithError(WebKitURISchemeRequest* request, const QString& message)
+{
+    GUniquePtr<GError> error(g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_FOUND, message.toUtf8().constData()));
+    webkit_uri_scheme_request_finish_error(request, error.get());
+}
+
+void WPEQtResourceSchemeHandler::handleRequest(WebKitURISchemeRequest* request)
+{
+    const QString path = QLatin1Char(':') + requestPath(request);
+    QResource resource(path);
+    if (resource.isValid() && resource.isDir())
+        resource.setFileName(path + QStringLiteral("/index.html"));
+    if (!resource.isValid() || resource.isDir()) {
+        finishWithError(request, QStringLiteral("Resource not found: %1").arg(path));
+        return;
+    }
+
+    GBytes* bytes;
+    if (resource.compressionAlgorithm() == QResource::NoCompression) {
+        // The data of compiled in resources stays valid for the lifetime of
+        // the process.
+        bytes = g_bytes_new_static(resource.data(), resource.size());
+    } else {
+        auto* data = new QByteArray(resource.uncompressedData());
+        bytes = g_bytes_new_with_free_func(data->constData(), data->size(), [](gpointer data) {
+            delete static_cast<QByteArray*>(data);
+        }, data);
+    }
+    finish(request, bytes, mimeTypeForPath(resource.fileName()));
+}
+
+WPEQtDirectorySchemeHandler::WPEQtDirectorySchemeHandler(const QString& directory)
+    : m_directory(QDir::cleanPath(QFileInfo(directory).absoluteFilePath()))
+{
+}
+
+void WPEQtDirectorySchemeHandler::handleRequest(WebKitURISchemeRequest* request)
+{
+    QString path = QDir::cleanPath(m_directory + QLatin1Char('/') + requestPath(request));
+    if (path != m_directory && !path.startsWith(m_directory + QLatin1Char('/'))) {
+        finishWithError(request, QStringLiteral("Invalid path"));
+        return;
+    }
+    if (QFileInfo(path).isDir())
+        path += QStringLiteral("/index.html");
+
+    GUniqueOutPtr<GError> error;
+    GMappedFile* file = g_mapped_file_new(QFile::encodeName(path).constData(), FALSE, &error.outPtr());
+    if (!file) {
+        finishWithError(request, QString::fromUtf8(error->message));
+        return;
+    }
+
+    // The bytes keep the file mapped until WebKit is done with them.
+    GBytes* bytes = g_mapped_file_get_bytes(file);
+    g_mapped_file_unref(file);
+    finish(request, bytes, mimeTypeForPath(path));
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <QString>
+#include <memory>
+#include <wpe/webkit.h>
+
+// Serves the requests of a custom URI scheme. Handlers are registered
+// process-wide and installed in every web context used by a view; the
+// qrc scheme, backed by the Qt resource system, is always available.
+class WPEQtSchemeHandler {
+public:
+    virtual ~WPEQtSchemeHandler() = default;
+
+    // Called on the main thread, the request must be finished eventually.
+    virtual void handleRequest(WebKitURISchemeRequest*) = 0;
+
+    static void registerHandler(const QString& scheme, std::unique_ptr<WPEQtSchemeHandler>&&);
+    static void attachContext(WebKitWebContext*);
+
+protected:
+    // Decoded path of the request URI.
+    static QString requestPath(WebKitURISchemeRequest*);
+    static QString mimeTypeForPath(const QString&);
+
+    // Takes ownership of bytes, which are streamed without being copied.
+    static void finish(WebKitURISchemeRequest*, GBytes*, const QString& mimeType);
+    static void finish(WebKitURISchemeRequest*, GInputStream*, gint64 length, const QString& mimeType);
+    static void finishWithError(WebKitURISchemeRequest*, const QString& message);
+
+private:
+    static void requestCallback(WebKitURISchemeRequest*, gpointer);
+};
+
+// Serves qrc:/path from the Qt resource system. Uncompressed resources are
+// streamed straight from the application's read-only data.
+class WPEQtResourceSchemeHandler final : public WPEQtSchemeHandler {
+public:
+    void handleRequest(WebKitURISchemeRequest*) override;
+};
+
+// Serves the files below a directory, memory mapped.
+class WPEQtDirectorySchemeHandler final : public WPEQtSchemeHandler {
+public:
+    explicit WPEQtDirectorySchemeHandler(const QString& directory);
+
+    void handleRequest(WebKitURISchemeRequest*) override;
+
+private:
+    QString m_directory;
+};
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtUrlMatcher.h"
+
+#include <algorithm>
+#include <functional>
+
+// Whether the rule stops before the path, query or fragment of the URL.
+static bool endsInAuthority(const QByteArray& rule)
+{
+    int start = rule.indexOf("://");
+    if (start < 0)
+        return false;
+
+    for (int i = start + 3; i < rule.size(); ++i) {
+        if (rule[i] == '/' || rule[i] == '?' || rule[i] == '#')
+            return false;
+    }
+    return true;
+}
+
+int WPEQtUrlMatcher::addNode()
+{
+    m_nodes.append(Node());
+    return m_nodes.size() - 1;
+}
+
+void WPEQtUrlMatcher::setRules(const QStringList& rules)
+{
+    m_rules = rules;
+    m_nodes.clear();
+    m_prefixes.clear();
+    m_prefixLengths.clear();
+    addNode();
+
+    for (int i = 0; i < m_rules.size(); ++i) {
+        const QByteArray rule = m_rules.at(i).trimmed().toUtf8();
+        if (rule.isEmpty())
+            continue;
+
+        if (rule.contains(':')) {
+            if (!m_prefixes.contains(rule))
+                m_prefixes.insert(rule, { i, endsInAuthority(rule) });
+            if (!m_prefixLengths.contains(rule.size()))
+                m_prefixLengths.append(rule.size());
+            continue;
+        }
+
+        const bool subdomains = rule.startsWith("*.");
+        const QList<QByteArray> labels = rule.mid(subdomains ? 2 : 0).toLower().split('.');
+        int node = 0;
+        for (auto it = labels.crbegin(); it != labels.crend(); ++it) {
+            int child = m_nodes[node].children.value(*it, -1);
+            if (child < 0) {
+                child = addNode();
+                m_nodes[node].children.insert(*it, child);
+            }
+            node = child;
+        }
+
+        int& target = subdomains ? m_nodes[node].subdomainRule : m_nodes[node].hostRule;
+        if (target < 0)
+            target = i;
+    }
+
+    // Longer prefixes are more specific, try them first.
+    std::sort(m_prefixLengths.begin(), m_prefixLengths.end(), std::greater<int>());
+}
+
+QByteArray WPEQtUrlMatcher::hostOfUrl(const QByteArray& url)
+{
+    int start = url.indexOf("://");
+    if (start < 0)
+        return QByteArray();
+    start += 3;
+
+    int end = start;
+    while (end < url.size() && url[end] != '/' && url[end] != '?' && url[end] != '#')
+        ++end;
+
+    int userInfo = url.lastIndexOf('@', end - 1);
+    if (userInfo >= start)
+        start = userInfo + 1;
+
+    if (start < end && url[start] == '[') {
+        int bracket = url.indexOf(']', start);
+        return bracket > 0 && bracket < end ? url.mid(start + 1, bracket - start - 1).toLower() : QByteArray();
+    }
+
+    int port = url.indexOf(':', start);
+    if (port >= 0 && port < end)
+        end = port;
+    return url.mid(start, end - start).toLower();
+}
+
+int WPEQtUrlMatcher::match(const QByteArray& url) const
+{
+    for (int length : m_prefixLengths) {
+        if (length > url.size())
+            continue;
+        auto it = m_prefixes.constFind(QByteArray::fromRawData(url.constData(), length));
+        if (it == m_prefixes.constEnd())
+            continue;
+
+        // The authority must end where the rule does, or be followed by a
+        // port. Anything else after the colon is user info for another host.
+        if (it->endsInAuthority && length < url.size()) {
+            int end = length;
+            if (url[end] == ':') {
+                ++end;
+                while (end < url.size() && url[end] >= '0' && url[end] <= '9')
+                    ++end;
+            }
+            if (end < url.size() && url[end] != '/' && url[end] != '?' && url[end] != '#')
+                continue;
+        }
+        return it->rule;
+    }
+
+    if (m_nodes.size() <= 1)
+        return -1;
+
+    const QByteArray host = hostOfUrl(url);
+    if (host.isEmpty())
+        return -1;
+
+    // Walk the labels from the last one, remembering the deepest
+    // subdomain rule passed on the way.
+    int match = -1;
+    int node = 0;
+    int end = host.size();
+    while (end > 0) {
+        int dot = host.lastIndexOf('.', end - 1);
+        auto it = m_nodes[node].children.constFind(QByteArray::fromRawData(host.constData() + dot + 1, end - dot - 1));
+        if (it == m_nodes[node].children.constEnd())
+            return match;
+
+        node = it.value();
+        end = dot;
+        if (end < 0)
+            break;
+        if (m_nodes[node].subdomainRule >= 0)
+            match = m_nodes[node].subdomainRule;
+    }
+
+    return m_nodes[node].hostRule >= 0 ? m_nodes[node].hostRule : match;
+}
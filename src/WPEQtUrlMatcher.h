@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+// Matches URLs against a list of rules, compiled once so that matching does
+// not depend on the number of rules:
+//
+//   example.com            the host example.com
+//   *.example.com          any subdomain of example.com
+//   https://example.com/a  URLs starting with the given prefix
+//
+// A prefix ending within the host or port, such as https://example.com,
+// only matches up to the end of the authority: https://example.com.evil.net
+// and https://example.com@evil.net do not match it.
+//
+// Hosts are kept in a trie of their labels, from the top level domain
+// down; prefixes in hash tables, one per distinct prefix length.
+class WPEQtUrlMatcher {
+public:
+    WPEQtUrlMatcher() = default;
+
+    void setRules(const QStringList&);
+    const QStringList& rules() const { return m_rules; }
+    bool isEmpty() const { return m_rules.isEmpty(); }
+
+    // Returns the index of the matching rule, or -1.
+    int match(const QByteArray& url) const;
+
+    static QByteArray hostOfUrl(const QByteArray& url);
+
+private:
+    struct Prefix {
+        int rule { -1 };
+        bool endsInAuthority { false };
+    };
+
+    struct Node {
+        QHash<QByteArray, int> children;
+        int hostRule { -1 };
+        int subdomainRule { -1 };
+    };
+
+    int addNode();
+
+    QStringList m_rules;
+    QVector<Node> m_nodes;
+    QHash<QByteArray, Prefix> m_prefixes;
+    QVector<int> m_prefixLengths;
+};
@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtUserContent.h"
+
+#include "WPEQtView.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <wtf/glib/GUniquePtr.h>
+
+namespace {
+
+struct CachedContent {
+    gpointer content;
+    int users;
+};
+
+}
+
+static QHash<QByteArray, CachedContent>& contentCache()
+{
+    static QHash<QByteArray, CachedContent> cache;
+    return cache;
+}
+
+static GUniquePtr<char*> patternList(const QVariant& value)
+{
+    const QStringList patterns = value.toStringList();
+    if (patterns.isEmpty())
+        return nullptr;
+
+    char** list = g_new0(char*, patterns.size() + 1);
+    for (int i = 0; i < patterns.size(); ++i)
+        list[i] = g_strdup(patterns.at(i).toUtf8().constData());
+    return GUniquePtr<char*>(list);
+}
+
+QString localFilePath(const QUrl& url)
+{
+    if (url.scheme() == QLatin1String("qrc"))
+        return QLatin1Char(':') + url.path();
+    if (url.isLocalFile())
+        return url.toLocalFile();
+    if (url.scheme().isEmpty())
+        return url.path();
+    return QString();
+}
+
+// Calls function with the NUL terminated contents of the file at path.
+// WebKit copies the source into the script object, so the file is read into
+// a temporary buffer rather than mapped: a mapping would not outlive the call
+// and a file truncated meanwhile would fault on access.
+template<typename Function>
+static bool withFileContents(const QString& path, Function&& function)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QByteArray contents = file.readAll();
+    function(contents.constData());
+    return true;
+}
+
+WPEQtUserContent::WPEQtUserContent()
+{
+}
+
+WPEQtUserContent::~WPEQtUserContent()
+{
+    setManager(nullptr);
+    for (const auto& item : qAsConst(m_scripts))
+        release(item);
+    for (const auto& item : qAsConst(m_styleSheets))
+        release(item);
+    for (const auto& item : qAsConst(m_internalScripts))
+        release(item);
+}
+
+void WPEQtUserContent::setManager(WebKitUserContentManager* manager)
+{
+    if (m_manager.get() == manager)
+        return;
+
+    if (m_manager) {
+        webkit_user_content_manager_remove_all_scripts(m_manager.get());
+        webkit_user_content_manager_remove_all_style_sheets(m_manager.get());
+    }
+
+    m_manager = manager;
+    if (!m_manager)
+        return;
+
+    for (const auto& item : qAsConst(m_internalScripts))
+        addToManager(item);
+    for (const auto& item : qAsConst(m_scripts))
+        addToManager(item);
+    for (const auto& item : qAsConst(m_styleSheets))
+        addToManager(item);
+}
+
+bool WPEQtUserContent::acquire(const QVariant& entry, bool styleSheet, Item& item)
+{
+    // A plain string is the URL of the file to load.
+    QVariantMap options;
+    if (entry.canConvert<QVariantMap>())
+        options = entry.toMap();
+    else
+        options.insert(QStringLiteral("url"), entry.toUrl());
+
+    const bool allFrames = options.value(QStringLiteral("allFrames")).toBool();
+    const int time = options.value(QStringLiteral("injectionTime"), WPEQtView::DocumentStart).toInt();
+    const int level = options.value(QStringLiteral("level"), WPEQtView::UserLevel).toInt();
+    const QVariant allowList = options.value(QStringLiteral("allowList"));
+    const QVariant blockList = options.value(QStringLiteral("blockList"));
+
+    QString source;
+    QString path;
+    if (options.contains(QStringLiteral("source")))
+        source = options.value(QStringLiteral("source")).toString();
+    else {
+        path = localFilePath(options.value(QStringLiteral("url")).toUrl());
+        if (path.isEmpty()) {
+            qWarning("Only local and qrc user content files are supported");
+            return false;
+        }
+    }
+
+    QByteArray key = styleSheet ? "css" : "js";
+    key += '\x1f' + QByteArray::number(allFrames) + '\x1f' + QByteArray::number(styleSheet ? level : time);
+    key += '\x1f' + allowList.toStringList().join(QChar(0x1e)).toUtf8();
+    key += '\x1f' + blockList.toStringList().join(QChar(0x1e)).toUtf8();
+    if (path.isEmpty())
+        key += "\x1fsource\x1f" + source.toUtf8();
+    else {
+        // Modified files get a new cache entry.
+        QFileInfo info(path);
+        key += "\x1f" "file\x1f" + info.absoluteFilePath().toUtf8();
+        key += '\x1f' + QByteArray::number(info.size()) + '\x1f' + QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+    }
+
+    auto& cache = contentCache();
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        it->users++;
+        item = { key, it->content, styleSheet };
+        return true;
+    }
+
+    auto frames = allFrames ? WEBKIT_USER_CONTENT_INJECT_ALL_FRAMES : WEBKIT_USER_CONTENT_INJECT_TOP_FRAME;
+    auto allow = patternList(allowList);
+    auto block = patternList(blockList);
+    gpointer content = nullptr;
+    auto create = [&](const char* data) {
+        if (styleSheet) {
+            content = webkit_user_style_sheet_new(data, frames,
+                level == WPEQtView::AuthorLevel ? WEBKIT_USER_STYLE_LEVEL_AUTHOR : WEBKIT_USER_STYLE_LEVEL_USER,
+                allow.get(), block.get());
+        } else {
+            content = webkit_user_script_new(data, frames,
+                time == WPEQtView::DocumentEnd ? WEBKIT_USER_SCRIPT_INJECT_AT_DOCUMENT_END : WEBKIT_USER_SCRIPT_INJECT_AT_DOCUMENT_START,
+                allow.get(), block.get());
+        }
+    };
+
+    if (path.isEmpty())
+        create(source.toUtf8().constData());
+    else if (!withFileContents(path, create)) {
+        qWarning("Failed to read user content file %s", qPrintable(path));
+        return false;
+    }
+
+    cache.insert(key, { content, 1 });
+    item = { key, content, styleSheet };
+    return true;
+}
+
+void WPEQtUserContent::release(const Item& item)
+{
+    auto& cache = contentCache();
+    auto it = cache.find(item.key);
+    if (it == cache.end() || --it->users)
+        return;
+
+    if (item.styleSheet)
+        webkit_user_style_sheet_unref(static_cast<WebKitUserStyleSheet*>(item.content));
+    else
+        webkit_user_script_unref(static_cast<WebKitUserScript*>(item.content));
+    cache.erase(it);
+}
+
+void WPEQtUserContent::addToManager(const Item& item)
+{
+    if (item.styleSheet)
+        webkit_user_content_manager_add_style_sheet(m_manager.get(), static_cast<WebKitUserStyleSheet*>(item.content));
+    else
+        webkit_user_content_manager_add_script(m_manager.get(), static_cast<WebKitUserScript*>(item.content));
+}
+
+void WPEQtUserContent::replaceItems(QVector<Item>& items, QVector<Item>&& newItems)
+{
+    if (m_manager) {
+#if WEBKIT_CHECK_VERSION(2, 32, 0)
+        for (const auto& item : qAsConst(items)) {
+            if (item.styleSheet)
+                webkit_user_content_manager_remove_style_sheet(m_manager.get(), static_cast<WebKitUserStyleSheet*>(item.content));
+            else
+                webkit_user_content_manager_remove_script(m_manager.get(), static_cast<WebKitUserScript*>(item.content));
+        }
+#else
+        // Items can only be removed all at once, add back the ones that stay.
+        if (&items == &m_styleSheets)
+            webkit_user_content_manager_remove_all_style_sheets(m_manager.get());
+        else {
+            webkit_user_content_manager_remove_all_scripts(m_manager.get());
+            for (const auto& item : qAsConst(&items == &m_scripts ? m_internalScripts : m_scripts))
+                addToManager(item);
+        }
+#endif
+        for (const auto& item : qAsConst(newItems))
+            addToManager(item);
+    }
+
+    // The new items were acquired first, content used by both is kept.
+    for (const auto& item : qAsConst(items))
+        release(item);
+    items = std::move(newItems);
+}
+
+void WPEQtUserContent::setScripts(const QVariantList& scripts)
+{
+    QVector<Item> items;
+    items.reserve(scripts.size());
+    for (const auto& entry : scripts) {
+        Item item;
+        if (acquire(entry, false, item))
+            items.append(item);
+    }
+    replaceItems(m_scripts, std::move(items));
+}
+
+void WPEQtUserContent::setStyleSheets(const QVariantList& styleSheets)
+{
+    QVector<Item> items;
+    items.reserve(styleSheets.size());
+    for (const auto& entry : styleSheets) {
+        Item item;
+        if (acquire(entry, true, item))
+            items.append(item);
+    }
+    replaceItems(m_styleSheets, std::move(items));
+}
+
+void WPEQtUserContent::addInternalScript(const QByteArray& source)
+{
+    QVariantMap options;
+    options.insert(QStringLiteral("source"), QString::fromUtf8(source));
+
+    Item item;
+    if (!acquire(options, false, item))
+        return;
+
+    m_internalScripts.append(item);
+    if (m_manager)
+        addToManager(item);
+}
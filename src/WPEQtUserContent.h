@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <QByteArray>
+#include <QUrl>
+#include <QVariant>
+#include <QVector>
+#include <wpe/webkit.h>
+#include <wtf/glib/GRefPtr.h>
+
+// Path of a local or qrc URL that can be opened with QFile, empty otherwise.
+QString localFilePath(const QUrl&);
+
+// Keeps the user scripts and style sheets of a view in its
+// WebKitUserContentManager. The WebKitUserScript and WebKitUserStyleSheet
+// objects are cached process-wide, views using the same content share them
+// and their sources are read and converted only once.
+class WPEQtUserContent {
+public:
+    WPEQtUserContent();
+    ~WPEQtUserContent();
+
+    void setManager(WebKitUserContentManager*);
+
+    void setScripts(const QVariantList&);
+    void setStyleSheets(const QVariantList&);
+    void addInternalScript(const QByteArray& source);
+
+private:
+    struct Item {
+        QByteArray key;
+        gpointer content;
+        bool styleSheet;
+    };
+
+    static bool acquire(const QVariant&, bool styleSheet, Item&);
+    static void release(const Item&);
+
+    void replaceItems(QVector<Item>&, QVector<Item>&&);
+    void addToManager(const Item&);
+
+    GRefPtr<WebKitUserContentManager> m_manager;
+    QVector<Item> m_scripts;
+    QVector<Item> m_styleSheets;
+    QVector<Item> m_internalScripts;
+};
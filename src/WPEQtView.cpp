@@ -21,16 +21,31 @@
 #include "config.h"
 #include "WPEQtView.h"
 
+#include "WPEQtAssetPack.h"
+#include "WPEQtBridge.h"
+#include "WPEQtContentFilters.h"
 #include "WPEQtViewBackend.h"
 #include "WPEQtViewLoadRequest.h"
-#include "WPEQtViewLoadRequestPrivate.h"
 #include "WPEQtImContext.h"
+#include "WPEQtJSCValue.h"
+#include "WPEQtMainContext.h"
+#include "WPEQtResourceTiming.h"
+#include "WPEQtSchemeHandler.h"
+#include "WPEQtUserContent.h"
+#include "WPEQtWebKitThread.h"
+#include <QDateTime>
 #include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QQuickWindow>
+#include <QSGClipNode>
 #include <QSGSimpleTextureNode>
 #include <QScreen>
 #include <QtGlobal>
 #include <qpa/qplatformnativeinterface.h>
+#include <functional>
+#include <limits>
 #include <wtf/glib/GUniquePtr.h>
 
 /*!
@@ -45,28 +60,60 @@
   WPEView provides an API compatible with Qt's QtWebView component. However
   WPEView is limited to Linux platforms supporting EGL KHR extensions. WPEView
   was successfully tested with the EGLFS and Wayland-EGL QPAs.
+
+  By default WebKit runs on the GUI thread. When the \c WPEQT_WEBKIT_THREAD
+  environment variable is set to \c 1 it runs on a thread of its own instead,
+  for the whole application, so that slow QML frames and WebKit do not hold
+  each other up. Calls are then forwarded to that thread and results are
+  delivered back in batches, see webKitThreadStatistics(). In this mode
+  messageHandlers, registerObject(), userScripts, userStyleSheets,
+  contentFilters, websiteData, resourceTimingEnabled, allowedUrls and input
+  methods are not available, and WPEWebsiteData must not be used.
 */
 WPEQtView::WPEQtView(QQuickItem* parent)
     : QQuickItem(parent)
+    , m_userContent(std::make_unique<WPEQtUserContent>())
+    , m_contentFilters(std::make_shared<WPEQtContentFilters>())
 {
     connect(this, &QQuickItem::windowChanged, this, &WPEQtView::configureWindow);
     setFlag(ItemHasContents, true);
     setAcceptedMouseButtons(Qt::AllButtons);
     setAcceptHoverEvents(true);
     setAcceptTouchEvents(true);
+
+    m_replayTimer.setSingleShot(true);
+    m_replayTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_replayTimer, &QTimer::timeout, this, &WPEQtView::replayPendingInputEvents);
+
+    WPEQtMainContext::viewCreated();
 }
 
 WPEQtView::~WPEQtView()
 {
-    g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyUrlChangedCallback), this);
-    g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyTitleChangedCallback), this);
-    g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyLoadChangedCallback), this);
-    g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyLoadFailedCallback), this);
-    g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyLoadProgressCallback), this);
-    g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyWebProcessTerminatedCallback), this);
-    g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(createRequested), this);
+    WPEQtMainContext::viewDestroyed();
+
+    const auto handlers = m_messageHandlerIds.keys();
+    for (const auto& name : handlers)
+        unregisterMessageHandler(name);
+
+    // Once this returns no more callbacks can run for the view, with a
+    // WebKit thread the web view and its backend are destroyed there.
+    WPEQtWebKitThread::invokeAndWait([this] {
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyUrlChangedCallback), this);
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyTitleChangedCallback), this);
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyLoadChangedCallback), this);
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyLoadFailedCallback), this);
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyLoadProgressCallback), this);
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(notifyWebProcessTerminatedCallback), this);
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(createRequested), this);
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(decidePolicyCallback), this);
+#ifndef USE_2022_GLIB_API
+        g_signal_handlers_disconnect_by_func(m_webView.get(), reinterpret_cast<gpointer>(resourceLoadStartedCallback), this);
+#endif
 
-    webkit_web_view_terminate_web_process(m_webView.get());
+        webkit_web_view_terminate_web_process(m_webView.get());
+        m_webView = nullptr;
+    });
 }
 
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
@@ -82,18 +129,79 @@ void WPEQtView::geometryChanged(const QRectF& newGeometry, const QRectF&)
 
 void WPEQtView::configureWindow()
 {
+    // Connections to a previous window would outlive the move.
+    if (m_window)
+        disconnect(m_window, nullptr, this, nullptr);
+
     auto* win = window();
+    m_window = win;
     if (!win)
         return;
 
     win->setSurfaceType(QWindow::OpenGLSurface);
 
+    connect(win, &QQuickWindow::afterAnimating, this, &WPEQtView::flushPendingUpdates);
+    connect(win, &QWindow::screenChanged, this, &WPEQtView::updateScaleFactor);
+
     if (win->isSceneGraphInitialized())
         createWebView();
     else
         connect(win, &QQuickWindow::sceneGraphInitialized, this, &WPEQtView::createWebView);
 }
 
+void WPEQtView::scheduleFlush()
+{
+    if (m_flushScheduled)
+        return;
+
+    m_flushScheduled = true;
+    // Pending updates are flushed once per frame, right before the scene graph
+    // synchronizes. Without an exposed window there are no frames to wait for.
+    auto* win = window();
+    if (win && win->isExposed())
+        win->update();
+    else
+        QMetaObject::invokeMethod(this, "flushPendingUpdates", Qt::QueuedConnection);
+}
+
+void WPEQtView::flushPendingUpdates()
+{
+    if (!m_flushScheduled)
+        return;
+
+    m_flushScheduled = false;
+    if (m_backend)
+        m_backend->flushPendingInput();
+    if (m_bridge && m_webView)
+        m_bridge->flush();
+
+    const unsigned notifications = m_pendingNotifications;
+    m_pendingNotifications = 0;
+    if (notifications & UrlNotification)
+        Q_EMIT urlChanged();
+    if (notifications & TitleNotification)
+        Q_EMIT titleChanged();
+    if (notifications & LoadProgressNotification)
+        Q_EMIT loadProgressChanged();
+}
+
+void WPEQtView::notifyPropertyChanged(unsigned notification)
+{
+    m_pendingNotifications |= notification;
+    scheduleFlush();
+}
+
+// Features built on the user content manager, custom web contexts or
+// per view state read by WebKit need WebKit to run on the GUI thread.
+static bool unavailableOnWebKitThread(const char* feature)
+{
+    if (!WPEQtWebKitThread::instance())
+        return false;
+
+    qWarning("WPEView.%s is not available when WebKit runs on its own thread", feature);
+    return true;
+}
+
 static QOpenGLContext *glContext(QQuickWindow *window)
 {
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
@@ -119,133 +227,616 @@ void WPEQtView::createWebView()
         return;
 
     m_backend = backend.get();
-    auto settings = adoptGRef(webkit_settings_new_with_settings("enable-developer-extras", TRUE,
-        "enable-webgl", TRUE, "enable-mediasource", TRUE, nullptr));
-    m_webView = adoptGRef(WEBKIT_WEB_VIEW(g_object_new(WEBKIT_TYPE_WEB_VIEW,
-        "backend", webkit_web_view_backend_new(m_backend->backend(), [](gpointer data) {
-            delete static_cast<WPEQtViewBackend*>(data);
-        }, backend.release()),
-        "settings", settings.get(), nullptr)));
-
-    m_backend->setScaleFactor(window()->devicePixelRatio());
-
-    m_imContext = wpeqt_im_context_new(this);
-    webkit_web_view_set_input_method_context(m_webView.get(), m_imContext);
-
-    g_signal_connect_swapped(m_webView.get(), "notify::uri", G_CALLBACK(notifyUrlChangedCallback), this);
-    g_signal_connect_swapped(m_webView.get(), "notify::title", G_CALLBACK(notifyTitleChangedCallback), this);
-    g_signal_connect_swapped(m_webView.get(), "notify::estimated-load-progress", G_CALLBACK(notifyLoadProgressCallback), this);
-    g_signal_connect(m_webView.get(), "load-changed", G_CALLBACK(notifyLoadChangedCallback), this);
-    g_signal_connect(m_webView.get(), "load-failed", G_CALLBACK(notifyLoadFailedCallback), this);
-    g_signal_connect(m_webView.get(), "create", G_CALLBACK(createRequested), this);
-    g_signal_connect(m_webView.get(), "web-process-terminated", G_CALLBACK(notifyWebProcessTerminatedCallback), this);
+    WPEQtWebKitThread::invokeAndWait([&] {
+        auto settings = adoptGRef(webkit_settings_new_with_settings("enable-developer-extras", TRUE,
+            "enable-webgl", TRUE, "enable-mediasource", TRUE, nullptr));
+        auto userContentManager = adoptGRef(webkit_user_content_manager_new());
+        m_webView = adoptGRef(WEBKIT_WEB_VIEW(g_object_new(WEBKIT_TYPE_WEB_VIEW,
+            "backend", webkit_web_view_backend_new(m_backend->backend(), [](gpointer data) {
+                delete static_cast<WPEQtViewBackend*>(data);
+            }, backend.release()),
+            "settings", settings.get(),
+            "web-context", m_websiteData ? m_websiteData->webContext() : webkit_web_context_get_default(),
+#ifdef USE_2022_GLIB_API
+            "network-session", m_websiteData ? m_websiteData->networkSession() : webkit_network_session_get_default(),
+#endif
+            "user-content-manager", userContentManager.get(), nullptr)));
+
+        WPEQtSchemeHandler::attachContext(webkit_web_view_get_context(m_webView.get()));
+
+        g_signal_connect_swapped(m_webView.get(), "notify::uri", G_CALLBACK(notifyUrlChangedCallback), this);
+        g_signal_connect_swapped(m_webView.get(), "notify::title", G_CALLBACK(notifyTitleChangedCallback), this);
+        g_signal_connect_swapped(m_webView.get(), "notify::estimated-load-progress", G_CALLBACK(notifyLoadProgressCallback), this);
+        g_signal_connect(m_webView.get(), "load-changed", G_CALLBACK(notifyLoadChangedCallback), this);
+        g_signal_connect(m_webView.get(), "load-failed", G_CALLBACK(notifyLoadFailedCallback), this);
+        g_signal_connect(m_webView.get(), "create", G_CALLBACK(createRequested), this);
+        g_signal_connect(m_webView.get(), "decide-policy", G_CALLBACK(decidePolicyCallback), this);
+        g_signal_connect(m_webView.get(), "web-process-terminated", G_CALLBACK(notifyWebProcessTerminatedCallback), this);
+#ifndef USE_2022_GLIB_API
+        g_signal_connect(m_webView.get(), "resource-load-started", G_CALLBACK(resourceLoadStartedCallback), this);
+#endif
+
+        if (!WPEQtWebKitThread::instance())
+            m_userContentManager = std::move(userContentManager);
+    });
+
+    // Input methods and the features built on the user content manager need
+    // WebKit on the GUI thread.
+    if (!WPEQtWebKitThread::instance()) {
+        m_userContent->setManager(m_userContentManager.get());
+        m_contentFilters->setManager(m_userContentManager.get());
+        for (const auto& name : qAsConst(m_messageHandlers))
+            registerMessageHandler(name);
+        if (m_bridge)
+            installBridge();
+
+        m_imContext = wpeqt_im_context_new(this);
+        webkit_web_view_set_input_method_context(m_webView.get(), m_imContext);
+    }
+
+    updateScaleFactor();
+    applyBackgroundColor();
+    if (m_zoomFactor != 1)
+        applyZoomFactor();
 
     if (!m_url.isEmpty())
-        webkit_web_view_load_uri(m_webView.get(), m_url.toString().toUtf8().constData());
-    else if (!m_html.isEmpty())
-        webkit_web_view_load_html(m_webView.get(), m_html.toUtf8().constData(), m_baseUrl.toString().toUtf8().constData());
+        loadUrl(m_url);
+    else if (!m_pendingData.isNull()) {
+        loadData(m_pendingData, m_pendingMimeType, m_pendingEncoding, m_pendingBaseUrl);
+        m_pendingData = QByteArray();
+    }
+
+    // Messages posted before the web view existed are still queued.
+    if (!m_postedMessages.isEmpty())
+        scheduleMessageDelivery();
 
     Q_EMIT webViewCreated();
 }
 
+void WPEQtView::loadUrl(const QUrl& url)
+{
+    WPEQtWebKitThread::invoke([webView = m_webView, uri = url.toString().toUtf8()] {
+        webkit_web_view_load_uri(webView.get(), uri.constData());
+    });
+}
+
 void WPEQtView::notifyUrlChangedCallback(WPEQtView* view)
 {
-    Q_EMIT view->urlChanged();
+    // Signal handlers run on the WebKit thread when there is one, the view
+    // is only updated on the GUI thread.
+    const gchar* uri = webkit_web_view_get_uri(view->m_webView.get());
+    QUrl url = uri ? QUrl(QString::fromUtf8(uri)) : QUrl();
+    const bool canGoBack = webkit_web_view_can_go_back(view->m_webView.get());
+    const bool canGoForward = webkit_web_view_can_go_forward(view->m_webView.get());
+    WPEQtWebKitThread::deliver(view, [view, url = std::move(url), canGoBack, canGoForward] {
+        view->m_canGoBack = canGoBack;
+        view->m_canGoForward = canGoForward;
+        if (url == view->m_currentUrl)
+            return;
+
+        view->m_currentUrl = url;
+        view->notifyPropertyChanged(UrlNotification);
+    });
 }
 
 void WPEQtView::notifyTitleChangedCallback(WPEQtView* view)
 {
-    Q_EMIT view->titleChanged();
+    QString title = QString::fromUtf8(webkit_web_view_get_title(view->m_webView.get()));
+    WPEQtWebKitThread::deliver(view, [view, title = std::move(title)] {
+        if (title == view->m_title)
+            return;
+
+        view->m_title = title;
+        view->notifyPropertyChanged(TitleNotification);
+    });
 }
 
 void WPEQtView::notifyLoadProgressCallback(WPEQtView* view)
 {
-    Q_EMIT view->loadProgressChanged();
+    // WebKit reports fractions, most of them round to the same percentage.
+    int progress = webkit_web_view_get_estimated_load_progress(view->m_webView.get()) * 100;
+    WPEQtWebKitThread::deliver(view, [view, progress] {
+        if (progress == view->m_loadProgress)
+            return;
+
+        view->m_loadProgress = progress;
+        view->notifyPropertyChanged(LoadProgressNotification);
+    });
 }
 
-void WPEQtView::notifyLoadChangedCallback(WebKitWebView*, WebKitLoadEvent event, WPEQtView* view)
+void WPEQtView::emitLoadingChanged(const QUrl& url, LoadStatus status, const QString& errorString)
 {
-    bool statusSet = false;
-    WPEQtView::LoadStatus loadStatus;
-    switch (event) {
-    case WEBKIT_LOAD_STARTED:
-        loadStatus = WPEQtView::LoadStatus::LoadStartedStatus;
-        statusSet = true;
-        break;
-    case WEBKIT_LOAD_FINISHED:
-        loadStatus = WPEQtView::LoadStatus::LoadSucceededStatus;
-        statusSet = !view->errorOccured();
-        view->setErrorOccured(false);
-        break;
-    default:
-        break;
-    }
+    // The request is a value type, handlers get their own copy and no
+    // object is allocated per load event.
+    Q_EMIT loadingChanged(WPEQtViewLoadRequest(url, status, errorString, m_loadStartTime, m_loadTimer.isValid() ? m_loadTimer.elapsed() : 0));
+}
 
-    if (statusSet) {
-        WPEQtViewLoadRequestPrivate loadRequestPrivate(view->url(), loadStatus, "");
-        std::unique_ptr<WPEQtViewLoadRequest> loadRequest = std::make_unique<WPEQtViewLoadRequest>(loadRequestPrivate);
-        Q_EMIT view->loadingChanged(loadRequest.get());
-    }
+void WPEQtView::notifyLoadChangedCallback(WebKitWebView* webView, WebKitLoadEvent event, WPEQtView* view)
+{
+    const QUrl uri(QString::fromUtf8(webkit_web_view_get_uri(webView)));
+    const bool isLoading = webkit_web_view_is_loading(webView);
+    const bool canGoBack = webkit_web_view_can_go_back(webView);
+    const bool canGoForward = webkit_web_view_can_go_forward(webView);
+    WPEQtWebKitThread::deliver(view, [view, event, uri, isLoading, canGoBack, canGoForward] {
+        view->m_isLoading = isLoading;
+        view->m_canGoBack = canGoBack;
+        view->m_canGoForward = canGoForward;
+
+        switch (event) {
+        case WEBKIT_LOAD_STARTED:
+            view->m_loadStartTime = QDateTime::currentMSecsSinceEpoch();
+            view->m_loadTimer.start();
+            view->m_prefetchHints.navigationStarted(uri);
+            view->emitLoadingChanged(view->url(), LoadStartedStatus);
+            break;
+        case WEBKIT_LOAD_REDIRECTED:
+            view->emitLoadingChanged(uri, LoadRedirectedStatus);
+            break;
+        case WEBKIT_LOAD_COMMITTED:
+            // Compiled scripts live in the page and are gone with it.
+            view->m_definedScripts.clear();
+            view->m_scriptGeneration++;
+            view->emitLoadingChanged(view->url(), LoadCommittedStatus);
+            break;
+        case WEBKIT_LOAD_FINISHED:
+            view->m_prefetchHints.navigationFinished(!view->errorOccured());
+            if (!view->errorOccured())
+                view->emitLoadingChanged(view->url(), LoadSucceededStatus);
+            view->setErrorOccured(false);
+            break;
+        }
+    });
 }
 
 void WPEQtView::notifyLoadFailedCallback(WebKitWebView*, WebKitLoadEvent, const gchar* failingURI, GError* error, WPEQtView* view)
 {
-    view->setErrorOccured(true);
-
     WPEQtView::LoadStatus loadStatus;
     if (g_error_matches(error, WEBKIT_NETWORK_ERROR, WEBKIT_NETWORK_ERROR_CANCELLED))
         loadStatus = WPEQtView::LoadStatus::LoadStoppedStatus;
     else
         loadStatus = WPEQtView::LoadStatus::LoadFailedStatus;
 
-    WPEQtViewLoadRequestPrivate loadRequestPrivate(QUrl(QString(failingURI)), loadStatus, error->message);
-    std::unique_ptr<WPEQtViewLoadRequest> loadRequest = std::make_unique<WPEQtViewLoadRequest>(loadRequestPrivate);
-    Q_EMIT view->loadingChanged(loadRequest.get());
+    const QUrl url(QString::fromUtf8(failingURI));
+    const QString errorString = QString::fromUtf8(error->message);
+#ifdef USE_2022_GLIB_API
+    const bool blockedByContentFilter = WPEQtContentFilters::isBlockedByContentFilter(error);
+#endif
+    WPEQtWebKitThread::deliver(view, [=] {
+        view->setErrorOccured(true);
+#ifdef USE_2022_GLIB_API
+        // Without per resource signals only blocked page loads can be counted.
+        if (blockedByContentFilter)
+            view->m_contentFilters->noteBlockedRequest();
+#endif
+        view->emitLoadingChanged(url, loadStatus, errorString);
+    });
+}
+
+#ifndef USE_2022_GLIB_API
+void WPEQtView::resourceLoadStartedCallback(WebKitWebView* webView, WebKitWebResource* resource, WebKitURIRequest* request, WPEQtView* view)
+{
+    if (view->m_resourceTiming)
+        view->m_resourceTiming->resourceLoadStarted(resource, request, resource == webkit_web_view_get_main_resource(webView));
+    if (!view->m_contentFilterList.isEmpty())
+        view->m_contentFilters->resourceLoadStarted(resource);
+}
+#endif
+
+struct ScriptMessageHandlerData {
+    WPEQtView* view;
+    QString name;
+};
+
+void WPEQtView::registerMessageHandler(const QString& name)
+{
+    if (!m_userContentManager || m_messageHandlerIds.contains(name))
+        return;
+
+    QByteArray handlerName = name.toUtf8();
+#ifdef USE_2022_GLIB_API
+    bool registered = webkit_user_content_manager_register_script_message_handler(m_userContentManager.get(), handlerName.constData(), nullptr);
+#else
+    bool registered = webkit_user_content_manager_register_script_message_handler(m_userContentManager.get(), handlerName.constData());
+#endif
+    if (!registered) {
+        qWarning("Failed to register script message handler %s", handlerName.constData());
+        return;
+    }
+
+    auto* data = new ScriptMessageHandlerData { this, name };
+    gulong id = g_signal_connect_data(m_userContentManager.get(), QByteArray("script-message-received::" + handlerName).constData(),
+        G_CALLBACK(scriptMessageReceivedCallback), data, [](gpointer data, GClosure*) {
+            delete static_cast<ScriptMessageHandlerData*>(data);
+        }, static_cast<GConnectFlags>(0));
+    m_messageHandlerIds.insert(name, id);
+}
+
+void WPEQtView::unregisterMessageHandler(const QString& name)
+{
+    gulong id = m_messageHandlerIds.take(name);
+    if (!id)
+        return;
+
+    g_signal_handler_disconnect(m_userContentManager.get(), id);
+#ifdef USE_2022_GLIB_API
+    webkit_user_content_manager_unregister_script_message_handler(m_userContentManager.get(), name.toUtf8().constData(), nullptr);
+#else
+    webkit_user_content_manager_unregister_script_message_handler(m_userContentManager.get(), name.toUtf8().constData());
+#endif
+}
+
+void WPEQtView::scriptMessageReceivedCallback(WebKitUserContentManager*, gpointer message, gpointer userData)
+{
+#ifdef USE_2022_GLIB_API
+    JSCValue* value = static_cast<JSCValue*>(message);
+#else
+    JSCValue* value = webkit_javascript_result_get_js_value(static_cast<WebKitJavascriptResult*>(message));
+#endif
+    auto* data = static_cast<ScriptMessageHandlerData*>(userData);
+    // The payload is converted right away, the JSCValue is only valid
+    // during the signal emission.
+    data->view->m_receivedMessages.append(qMakePair(data->name, jscValueToVariant(value)));
+    data->view->scheduleMessageDelivery();
+}
+
+void WPEQtView::scheduleMessageDelivery()
+{
+    if (m_messageDeliveryScheduled)
+        return;
+
+    m_messageDeliveryScheduled = true;
+    QMetaObject::invokeMethod(this, "deliverMessages", Qt::QueuedConnection);
+}
+
+void WPEQtView::deliverMessages()
+{
+    m_messageDeliveryScheduled = false;
+
+    if (!m_postedMessages.isEmpty() && m_webView) {
+        QByteArray script("(function(messages) { for (var i = 0; i < messages.length; ++i)\n"
+            "window.dispatchEvent(new CustomEvent('qtmessage', { detail: messages[i] })); })(");
+        script += QJsonDocument(m_postedMessages).toJson(QJsonDocument::Compact);
+        script += ")";
+        runJavaScript(QString::fromUtf8(script));
+        m_postedMessages = QJsonArray();
+    }
+
+    const auto messages = std::move(m_receivedMessages);
+    m_receivedMessages.clear();
+    for (const auto& message : messages) {
+        if (m_bridge && message.first == QLatin1String(WPEQtBridge::messageHandlerName()))
+            m_bridge->handleMessage(message.second);
+        else
+            Q_EMIT messageReceived(message.first, message.second);
+    }
+}
+
+void WPEQtView::installBridge()
+{
+    if (!m_userContentManager)
+        return;
+
+    registerMessageHandler(QString::fromLatin1(WPEQtBridge::messageHandlerName()));
+
+    // The bridge script runs at the start of every new document; the current
+    // one, if any, gets it right away.
+    const QByteArray script = WPEQtBridge::pageScript();
+    m_userContent->addInternalScript(script);
+    runJavaScript(QString::fromUtf8(script));
+}
+
+/*!
+  \qmlmethod void WPEView::prefetchDns(list<url> urls)
+
+  Resolves the host names of \a urls ahead of time, for pages the user is
+  likely to open next.
+
+  \sa preconnect(), prefetch(), prefetchStatistics()
+*/
+void WPEQtView::prefetchDns(const QList<QUrl>& urls)
+{
+    addResourceHints(WPEQtPrefetchHints::DnsPrefetch, urls);
+}
+
+/*!
+  \qmlmethod void WPEView::preconnect(list<url> urls)
+
+  Opens connections to the origins of \a urls ahead of time, including the
+  TLS handshake. The hints are given to the current page as
+  \c{<link rel="preconnect">} elements.
+
+  \sa prefetchDns(), prefetch()
+*/
+void WPEQtView::preconnect(const QList<QUrl>& urls)
+{
+    addResourceHints(WPEQtPrefetchHints::Preconnect, urls);
+}
+
+/*!
+  \qmlmethod void WPEView::prefetch(list<url> urls)
+
+  Fetches \a urls into the HTTP cache at low priority, so that navigating
+  to them later is served from the cache. The hints are given to the current
+  page as \c{<link rel="prefetch">} elements.
+
+  \sa prefetchDns(), preconnect()
+*/
+void WPEQtView::prefetch(const QList<QUrl>& urls)
+{
+    addResourceHints(WPEQtPrefetchHints::Prefetch, urls);
+}
+
+void WPEQtView::addResourceHints(WPEQtPrefetchHints::Type type, const QList<QUrl>& urls)
+{
+    if (!m_webView)
+        return;
+
+    QJsonArray links;
+    for (const auto& url : urls) {
+        if (!m_prefetchHints.add(type, url))
+            continue;
+
+        if (type == WPEQtPrefetchHints::DnsPrefetch) {
+            WPEQtWebKitThread::invoke([webView = m_webView, host = url.host().toUtf8()] {
+#ifdef USE_2022_GLIB_API
+                webkit_network_session_prefetch_dns(webkit_web_view_get_network_session(webView.get()), host.constData());
+#else
+                webkit_web_context_prefetch_dns(webkit_web_view_get_context(webView.get()), host.constData());
+#endif
+            });
+        } else {
+            links.append(url.toString());
+        }
+    }
+    if (links.isEmpty())
+        return;
+
+    QByteArray script("(function(rel, urls) { var head = document.head || document.documentElement;\n"
+        "urls.forEach(function(url) { var link = document.createElement('link'); link.rel = rel; link.href = url; head.appendChild(link); }); })(");
+    script += type == WPEQtPrefetchHints::Preconnect ? "'preconnect', " : "'prefetch', ";
+    script += QJsonDocument(links).toJson(QJsonDocument::Compact);
+    script += ")";
+    runJavaScript(QString::fromUtf8(script));
+}
+
+/*!
+  \qmlmethod object WPEView::prefetchStatistics()
+
+  Returns, for each of \c dnsPrefetch, \c preconnect and \c prefetch, the
+  number of distinct \c hints given, how many were \c used by a later
+  navigation, their \c hitRate (\c used divided by \c hints, 0 without
+  hints) and how many are still \c pending. A hint repeated while
+  pending is forwarded to WebKit again but counted once; pending hints
+  expire after five minutes. Also returns the number of page loads that
+  followed a hint and of those that did not, with their average load time
+  in milliseconds.
+
+  \sa prefetch()
+*/
+QVariantMap WPEQtView::prefetchStatistics() const
+{
+    return m_prefetchHints.statistics();
+}
+
+/*!
+  \qmlmethod void WPEView::registerUriScheme(string scheme, url directory)
+
+  Serves the files below the local \a directory with URLs of the custom
+  \a scheme, for example \c{app:/index.html}. Files are memory mapped and
+  handed to WebKit without copies, with a MIME type guessed from their
+  extension. The scheme is treated as secure and can be used for CORS
+  requests.
+
+  Schemes are registered for the whole application, not only for this
+  view. The \c qrc scheme, serving the Qt Resource system, is always
+  available.
+
+  \sa url, registerAssetPack()
+*/
+void WPEQtView::registerUriScheme(const QString& scheme, const QUrl& directory)
+{
+    const QString path = localFilePath(directory);
+    if (path.isEmpty() || path.startsWith(QLatin1Char(':'))) {
+        qWarning("URI schemes can only serve local directories");
+        return;
+    }
+
+    WPEQtSchemeHandler::registerHandler(scheme, std::make_unique<WPEQtDirectorySchemeHandler>(path));
+}
+
+/*!
+  \qmlmethod bool WPEView::registerAssetPack(string scheme, url pack)
+
+  Serves the files of the asset \a pack with URLs of the custom \a scheme.
+  Asset packs bundle a whole web application in a single file, avoiding to
+  open every file on its own; they are created with the \c wpeqt-pack tool:
+
+  \badcode
+  wpeqt-pack --compress dist/ app.pack
+  \endcode
+
+  The pack is memory mapped and looked up with a sorted index, compressed
+  files are inflated while being read. Returns false if the pack can not be
+  opened. As with registerUriScheme(), the scheme is registered for the
+  whole application.
+
+  \sa registerUriScheme()
+*/
+bool WPEQtView::registerAssetPack(const QString& scheme, const QUrl& pack)
+{
+    const QString path = localFilePath(pack);
+    if (path.isEmpty() || path.startsWith(QLatin1Char(':'))) {
+        qWarning("Asset packs must be local files");
+        return false;
+    }
+
+    auto handler = WPEQtAssetPackSchemeHandler::open(path);
+    if (!handler)
+        return false;
+
+    WPEQtSchemeHandler::registerHandler(scheme, std::move(handler));
+    return true;
+}
+
+/*!
+  \qmlmethod void WPEView::registerObject(string name, QtObject object)
+
+  Exposes the properties of \a object to the web page as
+  \c{window.qtbridge.objects[name]}. Property changes are batched and sent
+  to the page once per frame, only the properties that changed since the
+  previous update are transferred. The page is notified with a
+  \c qtbridgechange event on \c window.
+
+  Public slots and invokable methods of \a object can be called from the
+  page with \c{qtbridge.invoke(name, method, args...)}, which returns a
+  Promise resolved with the return value. The slots inherited from QObject,
+  such as \c deleteLater(), cannot be called.
+
+  \badcode
+  window.addEventListener("qtbridgechange", function() {
+      document.title = qtbridge.objects.player.position;
+  });
+  qtbridge.invoke("player", "seek", 42).then(function(ok) { ... });
+  \endcode
+
+  \sa unregisterObject()
+*/
+void WPEQtView::registerObject(const QString& name, QObject* object)
+{
+    if (unavailableOnWebKitThread("registerObject"))
+        return;
+
+    if (!m_bridge) {
+        m_bridge = new WPEQtBridge(this);
+        installBridge();
+    }
+    m_bridge->registerObject(name, object);
+}
+
+/*!
+  \qmlmethod void WPEView::unregisterObject(string name)
+
+  Removes the object registered as \a name from the web page.
+
+  \sa registerObject()
+*/
+void WPEQtView::unregisterObject(const QString& name)
+{
+    if (m_bridge)
+        m_bridge->unregisterObject(name);
 }
 
 void WPEQtView::notifyWebProcessTerminatedCallback(WebKitWebView*, WebKitWebProcessTerminationReason, WPEQtView* view)
 {
-    Q_EMIT view->webProcessCrashed();
+    WPEQtWebKitThread::deliver(view, [view] {
+        Q_EMIT view->webProcessCrashed();
+    });
 }
 
 void *WPEQtView::createRequested(WebKitWebView* web_view, WebKitNavigationAction* action, WPEQtView*)
 {
+    // Popups replace the current page, that navigation is subject to the
+    // allowedUrls policy like any other.
     webkit_web_view_load_request(web_view, webkit_navigation_action_get_request(action));
     return nullptr;
 }
 
+gboolean WPEQtView::decidePolicyCallback(WebKitWebView*, WebKitPolicyDecision* decision, WebKitPolicyDecisionType type, WPEQtView* view)
+{
+    if (view->m_urlMatcher.isEmpty())
+        return FALSE;
+
+    WebKitURIRequest* request;
+    switch (type) {
+    case WEBKIT_POLICY_DECISION_TYPE_NAVIGATION_ACTION:
+    case WEBKIT_POLICY_DECISION_TYPE_NEW_WINDOW_ACTION:
+        request = webkit_navigation_action_get_request(webkit_navigation_policy_decision_get_navigation_action(WEBKIT_NAVIGATION_POLICY_DECISION(decision)));
+        break;
+    case WEBKIT_POLICY_DECISION_TYPE_RESPONSE:
+        // Catches redirects to hosts that are not allowed.
+        request = webkit_response_policy_decision_get_request(WEBKIT_RESPONSE_POLICY_DECISION(decision));
+        break;
+    default:
+        return FALSE;
+    }
+
+    const char* uri = webkit_uri_request_get_uri(request);
+    const QByteArray url = QByteArray::fromRawData(uri, qstrlen(uri));
+    if (url.startsWith("about:"))
+        return FALSE;
+
+    int rule = view->m_urlMatcher.match(url);
+    if (rule >= 0) {
+        if (type != WEBKIT_POLICY_DECISION_TYPE_RESPONSE) {
+            view->m_ruleHits[rule]++;
+            view->m_allowedNavigations++;
+        }
+        return FALSE;
+    }
+
+    view->m_blockedNavigations++;
+    webkit_policy_decision_ignore(decision);
+    Q_EMIT view->navigationBlocked(QUrl(QString::fromUtf8(url)));
+    return TRUE;
+}
+
 QSGNode* WPEQtView::updatePaintNode(QSGNode* node, UpdatePaintNodeData*)
 {
     if (!m_webView || !m_backend)
         return node;
 
-    auto* textureNode = static_cast<QSGSimpleTextureNode*>(node);
-    if (!textureNode)
-        textureNode = new QSGSimpleTextureNode();
-
     GLuint textureId = m_backend->texture(glContext(window()));
     if (!textureId)
         return node;
 
+    // The scaled snapshot of a pinch would spill out of the item, the
+    // texture node is clipped to its bounds.
+    auto* clipNode = static_cast<QSGClipNode*>(node);
+    QSGSimpleTextureNode* textureNode;
+    if (!clipNode) {
+        clipNode = new QSGClipNode();
+        clipNode->setIsRectangular(true);
+        textureNode = new QSGSimpleTextureNode();
+        // A texture is wrapped for every frame, the previous one goes with it.
+        textureNode->setOwnsTexture(true);
+        clipNode->appendChildNode(textureNode);
+    } else
+        textureNode = static_cast<QSGSimpleTextureNode*>(clipNode->firstChild());
+
+    // Opaque textures are drawn without blending by the scene graph.
+    QQuickWindow::CreateTextureOptions options;
+    if (!isOpaque())
+        options |= QQuickWindow::TextureHasAlphaChannel;
+
+    const QSize textureSize = m_backend->textureSize();
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
-    QSGTexture *texture = QNativeInterface::QSGOpenGLTexture::fromNative(textureId, window(), m_size.toSize(), QQuickWindow::TextureHasAlphaChannel);
+    QSGTexture *texture = QNativeInterface::QSGOpenGLTexture::fromNative(textureId, window(), textureSize, options);
 #elif (QT_VERSION >= QT_VERSION_CHECK(5, 15, 0))
-    auto texture = window()->createTextureFromNativeObject(QQuickWindow::NativeObjectTexture, &textureId, 0, m_size.toSize(), QQuickWindow::TextureHasAlphaChannel);
+    auto texture = window()->createTextureFromNativeObject(QQuickWindow::NativeObjectTexture, &textureId, 0, textureSize, options);
 #else
-    auto texture = window()->createTextureFromId(textureId, m_size.toSize(), QQuickWindow::TextureHasAlphaChannel);
+    auto texture = window()->createTextureFromId(textureId, textureSize, options);
 #endif
     textureNode->setTexture(texture);
-    textureNode->setRect(boundingRect());
-    return textureNode;
+
+    if (m_pinchSettling && m_backend->frameStatistics().frames > m_pinchEndFrame) {
+        m_pinchSettling = false;
+        m_pinchScale = 1;
+    }
+
+    // Scaled snapshot of the last frame while pinching, smoothed since it is
+    // not drawn one to one.
+    QRectF rect = boundingRect();
+    if (m_pinchScale != 1)
+        rect = QRectF(m_pinchCenter + (rect.topLeft() - m_pinchCenter) * m_pinchScale, rect.size() * m_pinchScale);
+    textureNode->setFiltering(m_pinchScale != 1 ? QSGTexture::Linear : QSGTexture::Nearest);
+    textureNode->setRect(rect);
+    clipNode->setClipRect(boundingRect());
+    return clipNode;
 }
 
 QUrl WPEQtView::url() const
 {
-    if (!m_webView)
-        return m_url;
-
-    const gchar* uri = webkit_web_view_get_uri(m_webView.get());
-    return uri ? QUrl(QString(uri)) : m_url;
+    return m_currentUrl.isEmpty() ? m_url : m_currentUrl;
 }
 
 /*!
@@ -257,7 +848,10 @@ QUrl WPEQtView::url() const
   The URL is used as-is. URLs that originate from user input should
   be parsed with QUrl::fromUserInput().
 
-  \note The WPEView does not support loading content through the Qt Resource system.
+  Content of the Qt Resource system is loaded with \c qrc URLs, such as
+  \c{qrc:/ui/index.html}.
+
+  \sa registerUriScheme()
 */
 void WPEQtView::setUrl(const QUrl& url)
 {
@@ -267,7 +861,7 @@ void WPEQtView::setUrl(const QUrl& url)
     m_errorOccured = false;
     m_url = url;
     if (m_webView)
-        webkit_web_view_load_uri(m_webView.get(), m_url.toString().toUtf8().constData());
+        loadUrl(m_url);
 }
 
 /*!
@@ -276,13 +870,12 @@ void WPEQtView::setUrl(const QUrl& url)
 
   The current load progress of the web content, represented as
   an integer between 0 and 100.
+
+  Like for url and title, changes are notified at most once per frame.
 */
 int WPEQtView::loadProgress() const
 {
-    if (!m_webView)
-        return 0;
-
-    return webkit_web_view_get_estimated_load_progress(m_webView.get()) * 100;
+    return m_loadProgress;
 }
 
 /*!
@@ -293,10 +886,7 @@ int WPEQtView::loadProgress() const
 */
 QString WPEQtView::title() const
 {
-    if (!m_webView)
-        return "";
-
-    return webkit_web_view_get_title(m_webView.get());
+    return m_title;
 }
 
 /*!
@@ -310,6 +900,10 @@ bool WPEQtView::canGoBack() const
     if (!m_webView)
         return false;
 
+    // WebKit can not be queried from the GUI thread when it has its own.
+    if (WPEQtWebKitThread::instance())
+        return m_canGoBack;
+
     return webkit_web_view_can_go_back(m_webView.get());
 }
 
@@ -332,7 +926,8 @@ bool WPEQtView::canGoBack() const
 
   The \a loadRequest parameter holds the \e url and \e status of the request,
   as well as an \e errorString containing an error message for a failed
-  request.
+  request, and the \e startTime and \e elapsedTime of the load. The
+  request is passed by value and may be kept after the handler returns.
 
   \sa WPEViewLoadRequest
 */
@@ -341,6 +936,9 @@ bool WPEQtView::isLoading() const
     if (!m_webView)
         return false;
 
+    if (WPEQtWebKitThread::instance())
+        return m_isLoading;
+
     return webkit_web_view_is_loading(m_webView.get());
 }
 
@@ -355,6 +953,9 @@ bool WPEQtView::canGoForward() const
     if (!m_webView)
         return false;
 
+    if (WPEQtWebKitThread::instance())
+        return m_canGoForward;
+
     return webkit_web_view_can_go_forward(m_webView.get());
 }
 
@@ -365,8 +966,12 @@ bool WPEQtView::canGoForward() const
 */
 void WPEQtView::goBack()
 {
-    if (m_webView)
-        webkit_web_view_go_back(m_webView.get());
+    if (!m_webView)
+        return;
+
+    WPEQtWebKitThread::invoke([webView = m_webView] {
+        webkit_web_view_go_back(webView.get());
+    });
 }
 
 /*!
@@ -376,8 +981,12 @@ void WPEQtView::goBack()
 */
 void WPEQtView::goForward()
 {
-    if (m_webView)
-        webkit_web_view_go_forward(m_webView.get());
+    if (!m_webView)
+        return;
+
+    WPEQtWebKitThread::invoke([webView = m_webView] {
+        webkit_web_view_go_forward(webView.get());
+    });
 }
 
 /*!
@@ -387,8 +996,12 @@ void WPEQtView::goForward()
 */
 void WPEQtView::reload()
 {
-    if (m_webView)
-        webkit_web_view_reload(m_webView.get());
+    if (!m_webView)
+        return;
+
+    WPEQtWebKitThread::invoke([webView = m_webView] {
+        webkit_web_view_reload(webView.get());
+    });
 }
 
 /*!
@@ -398,8 +1011,12 @@ void WPEQtView::reload()
 */
 void WPEQtView::stop()
 {
-    if (m_webView)
-        webkit_web_view_stop_loading(m_webView.get());
+    if (!m_webView)
+        return;
+
+    WPEQtWebKitThread::invoke([webView = m_webView] {
+        webkit_web_view_stop_loading(webView.get());
+    });
 }
 
 /*!
@@ -416,76 +1033,156 @@ void WPEQtView::stop()
   is the base URL, then an image referenced with the relative url, \c diagram.png,
   should be at \c{http://www.example.com/documents/diagram.png}.
 
-  \note The WPEView does not support loading content through the Qt Resource system.
+  The content is converted to UTF-8 once and loaded with loadData().
 
-  \sa url
+  \sa url, loadData()
 */
 void WPEQtView::loadHtml(const QString& html, const QUrl& baseUrl)
 {
-    m_html = html;
-    m_baseUrl = baseUrl;
+    loadData(html.toUtf8(), QStringLiteral("text/html"), QStringLiteral("UTF-8"), baseUrl);
+}
+
+/*!
+  \qmlmethod void WPEView::loadData(ArrayBuffer data, string mimeType, string encoding, url baseUrl)
+
+  Loads \a data, of the given \a mimeType and \a encoding, to the web
+  view. Relative URLs in the content are resolved against \a baseUrl.
+
+  The data is handed to WebKit without being copied, which makes this the
+  preferred way to load large generated documents. When called before the
+  web view is created only this buffer is kept until it is loaded.
+
+  \sa loadHtml()
+*/
+void WPEQtView::loadData(const QByteArray& data, const QString& mimeType, const QString& encoding, const QUrl& baseUrl)
+{
     m_errorOccured = false;
 
-    if (m_webView)
-        webkit_web_view_load_html(m_webView.get(), html.toUtf8().constData(), baseUrl.toString().toUtf8().constData());
+    if (!m_webView) {
+        m_pendingData = data;
+        m_pendingMimeType = mimeType;
+        m_pendingEncoding = encoding;
+        m_pendingBaseUrl = baseUrl;
+        return;
+    }
+
+    // The GBytes holds a reference to the implicitly shared buffer.
+    auto* buffer = new QByteArray(data);
+    GBytes* bytes = g_bytes_new_with_free_func(buffer->constData(), buffer->size(), [](gpointer buffer) {
+        delete static_cast<QByteArray*>(buffer);
+    }, buffer);
+    WPEQtWebKitThread::invoke([webView = m_webView, bytes, mimeType = mimeType.toUtf8(), encoding = encoding.toUtf8(), baseUrl = baseUrl.toString().toUtf8()] {
+        webkit_web_view_load_bytes(webView.get(), bytes, mimeType.constData(),
+            encoding.isEmpty() ? nullptr : encoding.constData(), baseUrl.constData());
+        g_bytes_unref(bytes);
+    });
 }
 
 struct JavascriptCallbackData {
-    JavascriptCallbackData(QJSValue cb, QPointer<WPEQtView> obj)
+    JavascriptCallbackData(QJSValue cb, QPointer<WPEQtView> obj, bool spread = false)
         : callback(cb)
-        , object(obj) { }
+        , object(obj)
+        , spreadResult(spread) { }
 
     QJSValue callback;
     QPointer<WPEQtView> object;
+    // The result is an array holding the callback arguments.
+    bool spreadResult;
+    // Called on the GUI thread with whether the script succeeded.
+    std::function<void(bool)> completion;
 };
 
+static void callJavaScriptCallback(JavascriptCallbackData& data, const QVariant& result, const QString& errorMessage)
+{
+    if (data.completion)
+        data.completion(errorMessage.isNull());
+
+    if (!data.object.data() || data.callback.isUndefined())
+        return;
+
+    QQmlEngine* engine = qmlEngine(data.object.data());
+    if (!engine) {
+        qWarning("No JavaScript engine, unable to handle JavaScript callback!");
+        return;
+    }
+
+    QJSValueList args;
+    if (!errorMessage.isNull())
+        args.append(engine->newErrorObject(QJSValue::GenericError, errorMessage));
+    else if (data.spreadResult) {
+        const QVariantList results = result.toList();
+        for (const auto& value : results)
+            args.append(engine->toScriptValue(value));
+    } else
+        args.append(engine->toScriptValue(result));
+    data.callback.call(args);
+}
+
 static void jsAsyncReadyCallback(GObject* object, GAsyncResult* result, gpointer userData)
 {
     GUniqueOutPtr<GError> error;
     std::unique_ptr<JavascriptCallbackData> data(reinterpret_cast<JavascriptCallbackData*>(userData));
 
-    JSCValue* value = nullptr;
+    GRefPtr<JSCValue> value;
 
 #if WEBKIT_CHECK_VERSION(2, 40, 0)
-    value = webkit_web_view_evaluate_javascript_finish(WEBKIT_WEB_VIEW (object), result, &error.outPtr());
-    if (!value) {
-        qWarning("Error running javascript: %s", error->message);
-        return;
-    }
+    value = adoptGRef(webkit_web_view_evaluate_javascript_finish(WEBKIT_WEB_VIEW(object), result, &error.outPtr()));
 #else
     WebKitJavascriptResult* jsResult = webkit_web_view_run_javascript_finish(WEBKIT_WEB_VIEW(object), result, &error.outPtr());
-    if (!jsResult) {
-        qWarning("Error running javascript: %s", error->message);
-        return;
+    if (jsResult) {
+        value = webkit_javascript_result_get_js_value(jsResult);
+        webkit_javascript_result_unref(jsResult);
     }
-    value = webkit_javascript_result_get_js_value(jsResult);
 #endif
 
-    if (data->object.data()) {
-        QQmlEngine* engine = qmlEngine(data->object.data());
-        if (!engine) {
-            qWarning("No JavaScript engine, unable to handle JavaScript callback!");
-        } else {
-            QJSValueList args;
-            QVariant variant;
-            // FIXME: Handle more value types?
-            if (jsc_value_is_string(value)) {
-                GUniquePtr<gchar> strValue(jsc_value_to_string(value));
-                JSCContext* context = jsc_value_get_context(value);
-                JSCException* exception = jsc_context_get_exception(context);
-                if (exception) {
-                    qWarning("Error running javascript: %s", jsc_exception_get_message(exception));
-                    jsc_context_clear_exception(context);
-                } else
-                    variant.setValue(QString(g_strdup(strValue.get())));
-            }
-            args.append(engine->toScriptValue(variant));
-            data->callback.call(args);
-        }
+    if (!value)
+        qWarning("Error running javascript: %s", error->message);
+
+    if (WPEQtWebKitThread::instance()) {
+        // The value is converted on the WebKit thread, the callback is called
+        // and released on the GUI thread.
+        QVariant variant = value ? jscValueToVariant(value.get()) : QVariant();
+        QString errorMessage = value ? QString() : QString::fromUtf8(error->message);
+        std::shared_ptr<JavascriptCallbackData> callbackData(data.release());
+        WPEQtWebKitThread::deliver([callbackData = std::move(callbackData), variant = std::move(variant), errorMessage = std::move(errorMessage)] {
+            callJavaScriptCallback(*callbackData, variant, errorMessage);
+        });
+        return;
     }
-#if !WEBKIT_CHECK_VERSION(2, 40, 0)
-    webkit_javascript_result_unref(jsResult);
+
+    if (data->completion)
+        data->completion(!!value);
+
+    if (!data->object.data() || data->callback.isUndefined())
+        return;
+
+    QQmlEngine* engine = qmlEngine(data->object.data());
+    if (!engine) {
+        qWarning("No JavaScript engine, unable to handle JavaScript callback!");
+        return;
+    }
+
+    QJSValueList args;
+    if (value && data->spreadResult) {
+        const QVariantList results = jscValueToVariant(value.get()).toList();
+        for (const auto& result : results)
+            args.append(engine->toScriptValue(result));
+    } else if (value)
+        args.append(jscValueToJSValue(engine, value.get()));
+    else
+        args.append(engine->newErrorObject(QJSValue::GenericError, QString::fromUtf8(error->message)));
+    data->callback.call(args);
+}
+
+static void evaluateJavaScript(const GRefPtr<WebKitWebView>& webView, const QByteArray& script, JavascriptCallbackData* data)
+{
+    WPEQtWebKitThread::invoke([webView, script, data] {
+#if WEBKIT_CHECK_VERSION(2, 40, 0)
+        webkit_web_view_evaluate_javascript(webView.get(), script.constData(), script.size(), nullptr, nullptr, nullptr, jsAsyncReadyCallback, data);
+#else
+        webkit_web_view_run_javascript(webView.get(), script.constData(), nullptr, jsAsyncReadyCallback, data);
 #endif
+    });
 }
 
 /*!
@@ -495,6 +1192,11 @@ static void jsAsyncReadyCallback(GObject* object, GAsyncResult* result, gpointer
   In case a \a callback function is provided, it will be invoked after the \a script
   finished running.
 
+  The result is passed to the \a callback as a native QML value: numbers, booleans,
+  strings, arrays and plain objects are converted recursively, byte typed arrays
+  become an ArrayBuffer and other typed arrays an array of numbers. If the script
+  throws, the \a callback receives an Error object instead.
+
   \badcode
   runJavaScript("document.title", function(result) { console.log(result); });
   \endcode
@@ -502,13 +1204,760 @@ static void jsAsyncReadyCallback(GObject* object, GAsyncResult* result, gpointer
 void WPEQtView::runJavaScript(const QString& script, const QJSValue& callback)
 {
     std::unique_ptr<JavascriptCallbackData> data = std::make_unique<JavascriptCallbackData>(callback, QPointer<WPEQtView>(this));
-#if WEBKIT_CHECK_VERSION(2, 40, 0)
-    webkit_web_view_evaluate_javascript(m_webView.get(), script.toUtf8().constData(), -1, nullptr, nullptr, nullptr, jsAsyncReadyCallback, data.release());
+    evaluateJavaScript(m_webView, script.toUtf8(), data.release());
+}
+
+/*!
+  \qmlmethod void WPEView::runJavaScriptBatch(list<string> scripts, variant callback)
+
+  Evaluates all the JavaScript expressions in \a scripts with a single
+  request to the web process.
+
+  The \a callback receives two arrays with one entry per script: the
+  results, and the error messages of the scripts that threw, \c null for
+  those that did not.
+
+  \badcode
+  runJavaScriptBatch(["document.title", "window.scrollY"], function(results, errors) {
+      console.log(results[0], results[1]);
+  });
+  \endcode
+
+  \sa runJavaScript()
+*/
+void WPEQtView::runJavaScriptBatch(const QStringList& scripts, const QJSValue& callback)
+{
+    if (!m_webView)
+        return;
+
+    QByteArray batch("(function() { var results = [], errors = [];\n");
+    for (const auto& script : scripts) {
+        batch += "try { results.push((";
+        batch += script.toUtf8();
+        batch += "\n)); errors.push(null); } catch (e) { results.push(undefined); errors.push(String(e)); }\n";
+    }
+    batch += "return [results, errors]; })()";
+
+    evaluateJavaScript(m_webView, batch, new JavascriptCallbackData(callback, QPointer<WPEQtView>(this), true));
+}
+
+/*!
+  \qmlmethod int WPEView::compileJavaScript(string function)
+
+  Registers the JavaScript \a function, given as a function expression, for
+  repeated execution with runCompiledJavaScript() and returns its handle.
+
+  The function is only sent to the page on its first use after each page
+  load, later calls only transfer the handle and the arguments.
+
+  \badcode
+  var handle = compileJavaScript("function(selector) { return document.querySelectorAll(selector).length; }");
+  runCompiledJavaScript(handle, ["img"], function(count) { console.log(count); });
+  \endcode
+
+  \sa releaseCompiledJavaScript()
+*/
+int WPEQtView::compileJavaScript(const QString& function)
+{
+    int handle = m_nextScriptHandle++;
+    m_compiledScripts.insert(handle, function.toUtf8());
+    return handle;
+}
+
+/*!
+  \qmlmethod void WPEView::runCompiledJavaScript(int handle, list arguments, variant callback)
+
+  Calls the function registered with compileJavaScript() as \a handle with
+  the given \a arguments, which must be convertible to JSON. The \a callback
+  receives the result like for runJavaScript().
+*/
+void WPEQtView::runCompiledJavaScript(int handle, const QVariantList& arguments, const QJSValue& callback)
+{
+    auto it = m_compiledScripts.constFind(handle);
+    if (!m_webView || it == m_compiledScripts.constEnd())
+        return;
+
+    if (!m_definedScripts.contains(handle)) {
+        // The definition is evaluated on its own, so a function that throws
+        // when called stays defined. One that does not parse is sent again
+        // on the next call.
+        QByteArray definition("(window.__wpeqtCompiled = window.__wpeqtCompiled || {})[" + QByteArray::number(handle) + "] = (");
+        definition += it.value();
+        definition += "\n), undefined";
+        auto data = std::make_unique<JavascriptCallbackData>(QJSValue(), QPointer<WPEQtView>(this));
+        data->completion = [view = QPointer<WPEQtView>(this), handle, generation = m_scriptGeneration](bool succeeded) {
+            if (succeeded && view && view->m_scriptGeneration == generation && view->m_compiledScripts.contains(handle))
+                view->m_definedScripts.insert(handle);
+        };
+        evaluateJavaScript(m_webView, definition, data.release());
+    }
+
+    QByteArray script("window.__wpeqtCompiled[" + QByteArray::number(handle) + "].apply(null, ");
+    script += QJsonDocument(QJsonArray::fromVariantList(arguments)).toJson(QJsonDocument::Compact);
+    script += ")";
+
+    evaluateJavaScript(m_webView, script, new JavascriptCallbackData(callback, QPointer<WPEQtView>(this)));
+}
+
+/*!
+  \qmlmethod void WPEView::releaseCompiledJavaScript(int handle)
+
+  Releases the function registered with compileJavaScript() as \a handle.
+*/
+void WPEQtView::releaseCompiledJavaScript(int handle)
+{
+    if (!m_compiledScripts.remove(handle))
+        return;
+
+    if (m_definedScripts.remove(handle) && m_webView)
+        runJavaScript(QStringLiteral("delete window.__wpeqtCompiled[%1]").arg(handle));
+}
+
+/*!
+  \qmlproperty list<string> WPEView::messageHandlers
+
+  The names of the script message handlers available to the web page.
+  A page sends a message to the handler \c name with
+  \c{window.webkit.messageHandlers.name.postMessage(payload)}, which is
+  delivered by the messageReceived() signal.
+
+  \sa postMessage()
+*/
+QStringList WPEQtView::messageHandlers() const
+{
+    return m_messageHandlers;
+}
+
+void WPEQtView::setMessageHandlers(const QStringList& names)
+{
+    if (names == m_messageHandlers || unavailableOnWebKitThread("messageHandlers"))
+        return;
+
+    for (const auto& name : qAsConst(m_messageHandlers)) {
+        if (!names.contains(name))
+            unregisterMessageHandler(name);
+    }
+    m_messageHandlers = names;
+    for (const auto& name : qAsConst(m_messageHandlers))
+        registerMessageHandler(name);
+
+    Q_EMIT messageHandlersChanged();
+}
+
+/*!
+  \qmlproperty list<variant> WPEView::userScripts
+
+  The scripts injected into every document loaded in the view. Each entry
+  is either the URL of a local or \c qrc file, or an object with the
+  following properties:
+
+  \list
+  \li \c source or \c url: the script code, or the file to load it from.
+  \li \c injectionTime: \c WPEView.DocumentStart (the default) runs the
+      script before any of the page's own scripts, \c WPEView.DocumentEnd
+      once the document has been parsed.
+  \li \c allFrames: whether the script also runs in subframes, false by
+      default.
+  \li \c allowList and \c blockList: URL patterns of the pages the script
+      is limited to, or excluded from.
+  \endlist
+
+  Unlike running setup code with runJavaScript() after the page has loaded,
+  user scripts are in place before the first layout. Scripts are read once
+  and shared between all the views that use them; files are memory mapped
+  while being read.
+
+  \sa userStyleSheets
+*/
+QVariantList WPEQtView::userScripts() const
+{
+    return m_userScripts;
+}
+
+void WPEQtView::setUserScripts(const QVariantList& scripts)
+{
+    if (scripts == m_userScripts || unavailableOnWebKitThread("userScripts"))
+        return;
+
+    m_userScripts = scripts;
+    m_userContent->setScripts(m_userScripts);
+    Q_EMIT userScriptsChanged();
+}
+
+/*!
+  \qmlproperty list<variant> WPEView::userStyleSheets
+
+  The style sheets applied to every document loaded in the view. Entries
+  are given as for userScripts, with a \c level property taking
+  \c WPEView.UserLevel (the default) or \c WPEView.AuthorLevel instead of
+  \c injectionTime.
+
+  \sa userScripts
+*/
+QVariantList WPEQtView::userStyleSheets() const
+{
+    return m_userStyleSheets;
+}
+
+void WPEQtView::setUserStyleSheets(const QVariantList& styleSheets)
+{
+    if (styleSheets == m_userStyleSheets || unavailableOnWebKitThread("userStyleSheets"))
+        return;
+
+    m_userStyleSheets = styleSheets;
+    m_userContent->setStyleSheets(m_userStyleSheets);
+    Q_EMIT userStyleSheetsChanged();
+}
+
+/*!
+  \qmlproperty list<variant> WPEView::contentFilters
+
+  Content blocker rule lists, in the JSON format of WebKit content
+  extensions, applied to every load of the view. Each entry is either the
+  URL of a local or \c qrc file, or an object with a \c name and either the
+  rules as \c source or their file as \c url.
+
+  Rule lists are compiled once and stored in the application's cache
+  directory; later uses, also by other views and after restarts, load the
+  compiled filter instead. Filters are applied asynchronously, once compiled
+  or loaded.
+
+  \sa contentFilterStatistics()
+*/
+QVariantList WPEQtView::contentFilters() const
+{
+    return m_contentFilterList;
+}
+
+void WPEQtView::setContentFilters(const QVariantList& filters)
+{
+    if (filters == m_contentFilterList || unavailableOnWebKitThread("contentFilters"))
+        return;
+
+    m_contentFilterList = filters;
+    m_contentFilters->setFilters(m_contentFilterList);
+    Q_EMIT contentFiltersChanged();
+}
+
+/*!
+  \qmlmethod object WPEView::contentFilterStatistics()
+
+  Returns counters of the content filters of the view: the number of rule
+  lists compiled and the total compile time in milliseconds, the number of
+  filters found in the in-memory and the on-disk caches, the number of rule
+  lists that failed to compile and the number of blocked requests. With the
+  wpe-webkit-2.0 API only blocked page loads are counted.
+
+  \sa contentFilters
+*/
+QVariantMap WPEQtView::contentFilterStatistics() const
+{
+    const auto& stats = m_contentFilters->statistics();
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("compiledFilters"), stats.compiledFilters);
+    statistics.insert(QStringLiteral("compileTime"), stats.compileTime);
+    statistics.insert(QStringLiteral("memoryCacheHits"), stats.memoryCacheHits);
+    statistics.insert(QStringLiteral("diskCacheHits"), stats.diskCacheHits);
+    statistics.insert(QStringLiteral("failedFilters"), stats.failedFilters);
+    statistics.insert(QStringLiteral("blockedRequests"), stats.blockedRequests);
+    return statistics;
+}
+
+/*!
+  \qmlproperty WPEWebsiteData WPEView::websiteData
+
+  Where the view stores its website data: HTTP cache, cookies, local
+  storage and databases. Views sharing a WPEWebsiteData share their data.
+  The default storage of WebKit is used when not set.
+
+  Must be set before the view is shown, it can not be changed once the
+  web view is created.
+*/
+WPEQtWebsiteData* WPEQtView::websiteData() const
+{
+    return m_websiteData;
+}
+
+void WPEQtView::setWebsiteData(WPEQtWebsiteData* websiteData)
+{
+    if (websiteData == m_websiteData || unavailableOnWebKitThread("websiteData"))
+        return;
+
+    if (m_webView) {
+        qWarning("WPEView.websiteData can not be changed once the web view is created");
+        return;
+    }
+
+    m_websiteData = websiteData;
+    Q_EMIT websiteDataChanged();
+}
+
+/*!
+  \qmlproperty bool WPEView::resourceTimingEnabled
+
+  Whether the timing, HTTP status, MIME type and size of every resource
+  loaded by the view are recorded. The last 1024 resources are kept in
+  memory, the ones of the current page can be exported with
+  resourceTimingHar().
+
+  The cost of the capture is measured, see resourceTimingStatistics(), so
+  that it can be checked before leaving it enabled in production. Not
+  available with the wpe-webkit-2.0 API.
+*/
+bool WPEQtView::isResourceTimingEnabled() const
+{
+    return !!m_resourceTiming;
+}
+
+void WPEQtView::setResourceTimingEnabled(bool enabled)
+{
+    if (enabled == isResourceTimingEnabled() || unavailableOnWebKitThread("resourceTimingEnabled"))
+        return;
+
+#ifdef USE_2022_GLIB_API
+    if (enabled) {
+        qWarning("Resource timing is not supported with the wpe-webkit-2.0 API");
+        return;
+    }
+#endif
+
+    // Resources still loading only hold weak references to the recorder.
+    m_resourceTiming = enabled ? std::make_shared<WPEQtResourceTiming>() : nullptr;
+    Q_EMIT resourceTimingEnabledChanged();
+}
+
+/*!
+  \qmlmethod string WPEView::resourceTimingHar()
+
+  Returns the resources loaded for the current page, as a HAR 1.2 document.
+  Headers and connection timings are not recorded, the \c wait time is the
+  time to the response and \c receive the time to the end of the load.
+
+  \sa resourceTimingEnabled
+*/
+QString WPEQtView::resourceTimingHar() const
+{
+    if (!m_resourceTiming)
+        return QString();
+
+    return QString::fromUtf8(m_resourceTiming->toHar(title()));
+}
+
+/*!
+  \qmlmethod object WPEView::resourceTimingStatistics()
+
+  Returns the capacity of the resource timing ring, the number of resources
+  recorded, how many entries of the current page were dropped because the
+  ring was full, and the total and average time in microseconds spent
+  recording.
+
+  \sa resourceTimingEnabled
+*/
+QVariantMap WPEQtView::resourceTimingStatistics() const
+{
+    if (!m_resourceTiming)
+        return QVariantMap();
+
+    return m_resourceTiming->statistics();
+}
+
+/*!
+  \qmlproperty list<string> WPEView::allowedUrls
+
+  Restricts navigation to the URLs matching one of the given rules. When
+  empty, the default, every navigation is allowed. A rule is either
+  \list
+  \li a host name, such as \c{example.com}, matching that host only,
+  \li a host name prefixed with \c{*.}, such as \c{*.example.com},
+      matching its subdomains,
+  \li or a URL prefix, such as \c{https://example.com/app/} or \c{qrc:},
+      matching the URLs starting with it.
+  \endlist
+
+  A prefix that ends within the host, such as \c{https://example.com},
+  matches that host on any port but not longer host names:
+  \c{https://example.com.evil.net/}, \c{https://example.com@evil.net/} and
+  \c{https://example.com:x@evil.net/} are not allowed by it.
+
+  Navigations, new window requests and the final URL of responses are
+  checked natively; only blocked navigations are reported, by the
+  navigationBlocked() signal. \c about: URLs are always allowed.
+
+  \sa navigationStatistics()
+*/
+QStringList WPEQtView::allowedUrls() const
+{
+    return m_urlMatcher.rules();
+}
+
+void WPEQtView::setAllowedUrls(const QStringList& rules)
+{
+    if (rules == m_urlMatcher.rules() || unavailableOnWebKitThread("allowedUrls"))
+        return;
+
+    m_urlMatcher.setRules(rules);
+    m_ruleHits = QVector<quint64>(rules.size(), 0);
+    Q_EMIT allowedUrlsChanged();
+}
+
+/*!
+  \qmlproperty color WPEView::backgroundColor
+
+  The color drawn behind the page content, white by default. Pages without
+  a background of their own show through when it is transparent, the view
+  is then blended with the items below it.
+
+  With an opaque color the scene graph draws the view without blending,
+  which saves fill rate. Requires WPE WebKit 2.24 or newer.
+*/
+QColor WPEQtView::backgroundColor() const
+{
+    return m_backgroundColor;
+}
+
+void WPEQtView::setBackgroundColor(const QColor& color)
+{
+    if (color == m_backgroundColor)
+        return;
+
+    m_backgroundColor = color;
+    applyBackgroundColor();
+    update();
+    Q_EMIT backgroundColorChanged();
+}
+
+void WPEQtView::applyBackgroundColor()
+{
+    if (!m_webView)
+        return;
+
+#if WEBKIT_CHECK_VERSION(2, 24, 0)
+    const WebKitColor color = {
+        m_backgroundColor.redF(),
+        m_backgroundColor.greenF(),
+        m_backgroundColor.blueF(),
+        m_backgroundColor.alphaF()
+    };
+
+    WPEQtWebKitThread::invoke([webView = m_webView, color] {
+        webkit_web_view_set_background_color(webView.get(), &color);
+    });
 #else
-    webkit_web_view_run_javascript(m_webView.get(), script.toUtf8().constData(), nullptr, jsAsyncReadyCallback, data.release());
+    if (m_backgroundColor != Qt::white)
+        qWarning("WPEView.backgroundColor requires WPE WebKit 2.24 or newer");
 #endif
 }
 
+bool WPEQtView::isOpaque() const
+{
+    return m_backgroundColor.alpha() == 255;
+}
+
+/*!
+  \qmlproperty real WPEView::zoomFactor
+
+  The zoom level of the page, 1 by default. Unlike a \c scale transform on
+  the item, WebKit lays out and rasterizes the page again at the new level,
+  so text and images stay sharp.
+
+  \sa beginPinchZoom()
+*/
+qreal WPEQtView::zoomFactor() const
+{
+    return m_zoomFactor;
+}
+
+void WPEQtView::setZoomFactor(qreal factor)
+{
+    if (factor <= 0 || qFuzzyCompare(factor, m_zoomFactor))
+        return;
+
+    m_zoomFactor = factor;
+    applyZoomFactor();
+    Q_EMIT zoomFactorChanged();
+}
+
+void WPEQtView::applyZoomFactor()
+{
+    if (!m_webView)
+        return;
+
+    WPEQtWebKitThread::invoke([webView = m_webView, factor = m_zoomFactor] {
+        webkit_web_view_set_zoom_level(webView.get(), factor);
+    });
+}
+
+void WPEQtView::updateScaleFactor()
+{
+    // WebKit renders at the device pixel ratio, frames of the new size
+    // replace the texture as they arrive.
+    if (m_backend && window())
+        m_backend->setScaleFactor(window()->devicePixelRatio());
+}
+
+/*!
+  \qmlmethod void WPEView::beginPinchZoom()
+
+  Starts a pinch zoom gesture, for instance from a PinchArea. Until
+  endPinchZoom() is called, updatePinchZoom() scales the last frame drawn
+  by WebKit, which keeps the gesture smooth whatever the cost of laying out
+  the page. The page is rasterized again once, at the final zoomFactor,
+  when the gesture ends.
+
+  \badcode
+  PinchArea {
+      anchors.fill: webView
+      onPinchStarted: webView.beginPinchZoom()
+      onPinchUpdated: webView.updatePinchZoom(pinch.scale, pinch.center)
+      onPinchFinished: webView.endPinchZoom()
+  }
+  \endcode
+*/
+void WPEQtView::beginPinchZoom()
+{
+    m_pinching = true;
+    m_pinchSettling = false;
+    m_pinchScale = 1;
+}
+
+/*!
+  \qmlmethod void WPEView::updatePinchZoom(real scale, point center)
+
+  Scales the snapshot of the page by \a scale, relative to the zoomFactor
+  when the gesture began, around \a center in item coordinates.
+*/
+void WPEQtView::updatePinchZoom(qreal scale, const QPointF& center)
+{
+    if (!m_pinching || scale <= 0)
+        return;
+
+    m_pinchScale = scale;
+    m_pinchCenter = center;
+    update();
+}
+
+/*!
+  \qmlmethod void WPEView::endPinchZoom()
+
+  Ends the pinch zoom gesture and applies its scale to zoomFactor, keeping
+  the point under its center in place. The scaled snapshot stays until
+  WebKit displays the page at the new zoom level.
+*/
+void WPEQtView::endPinchZoom()
+{
+    if (!m_pinching)
+        return;
+
+    m_pinching = false;
+    if (qFuzzyCompare(m_pinchScale, 1) || !m_webView) {
+        m_pinchScale = 1;
+        update();
+        return;
+    }
+
+    const qreal oldFactor = m_zoomFactor;
+    const qreal newFactor = m_zoomFactor * m_pinchScale;
+    m_pinchSettling = true;
+    // Frames displayed before the scroll below completes may predate the
+    // new zoom level, they keep the snapshot.
+    m_pinchEndFrame = std::numeric_limits<quint64>::max();
+
+    // WebKit zooms from the top left corner of the viewport, scroll so the
+    // document point under the center of the gesture stays there.
+    const QByteArray anchor = QStringLiteral("window.__wpeqtPinchAnchor = [window.scrollX + %1, window.scrollY + %2];")
+        .arg(m_pinchCenter.x() / oldFactor).arg(m_pinchCenter.y() / oldFactor).toUtf8();
+    evaluateJavaScript(m_webView, anchor, new JavascriptCallbackData(QJSValue(), QPointer<WPEQtView>(this)));
+    setZoomFactor(newFactor);
+    const QByteArray scroll = QStringLiteral("window.scrollTo(window.__wpeqtPinchAnchor[0] - %1, window.__wpeqtPinchAnchor[1] - %2);"
+        "delete window.__wpeqtPinchAnchor;")
+        .arg(m_pinchCenter.x() / newFactor).arg(m_pinchCenter.y() / newFactor).toUtf8();
+    auto data = std::make_unique<JavascriptCallbackData>(QJSValue(), QPointer<WPEQtView>(this));
+    data->completion = [view = QPointer<WPEQtView>(this)](bool) {
+        if (!view || !view->m_pinchSettling || !view->m_backend)
+            return;
+        view->m_pinchEndFrame = view->m_backend->frameStatistics().frames;
+    };
+    evaluateJavaScript(m_webView, scroll, data.release());
+}
+
+/*!
+  \qmlsignal WPEView::navigationBlocked(url url)
+
+  This signal is emitted when a navigation to \a url is blocked because it
+  does not match any of the allowedUrls.
+*/
+
+/*!
+  \qmlmethod object WPEView::navigationStatistics()
+
+  Returns the number of allowed and blocked navigations, and in \c rules
+  the number of navigations allowed by each of the allowedUrls.
+
+  \sa allowedUrls
+*/
+QVariantMap WPEQtView::navigationStatistics() const
+{
+    QVariantMap rules;
+    for (int i = 0; i < m_ruleHits.size(); ++i)
+        rules.insert(m_urlMatcher.rules().at(i), m_ruleHits.at(i));
+
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("allowedNavigations"), m_allowedNavigations);
+    statistics.insert(QStringLiteral("blockedNavigations"), m_blockedNavigations);
+    statistics.insert(QStringLiteral("rules"), rules);
+    return statistics;
+}
+
+/*!
+  \qmlsignal WPEView::messageReceived(string name, variant payload)
+
+  This signal is emitted when the web page posts a message to the script
+  message handler \a name. The \a payload is converted to a native value as
+  for runJavaScript(). Messages posted during one event loop iteration are
+  delivered together.
+
+  \sa messageHandlers
+*/
+
+/*!
+  \qmlmethod void WPEView::postMessage(string name, variant payload)
+
+  Sends a message to the web page, where it is dispatched as a \c qtmessage
+  CustomEvent on \c window whose \c detail holds the \a name and the
+  \a payload, which must be convertible to JSON. Messages posted during one
+  event loop iteration are sent to the page together. Messages posted before
+  the web view is created are kept and sent once it exists.
+
+  \badcode
+  window.addEventListener("qtmessage", function(event) {
+      console.log(event.detail.name, event.detail.payload);
+  });
+  \endcode
+*/
+void WPEQtView::postMessage(const QString& name, const QVariant& payload)
+{
+    QJsonObject message;
+    message.insert(QStringLiteral("name"), name);
+    message.insert(QStringLiteral("payload"), QJsonValue::fromVariant(payload));
+    m_postedMessages.append(message);
+    scheduleMessageDelivery();
+}
+
+/*!
+  \qmlmethod void WPEView::sendInputEvents(list events)
+
+  Dispatches the synthetic input \a events directly to the web page, in order
+  and without the per-frame coalescing applied to user input.
+
+  Each event is an object with a \e type property, one of \c keyPress,
+  \c keyRelease, \c mouseMove, \c mousePress, \c mouseRelease, \c wheel,
+  \c touchPress, \c touchMove or \c touchRelease. Key events use the \e key,
+  \e text and \e modifiers properties, pointer and touch events the \e x and
+  \e y item coordinates, plus \e button for mouse buttons, \e dx and \e dy
+  pixel deltas for wheel events and \e id for touch points. An optional
+  \e time property holds the event timestamp in milliseconds.
+
+  \badcode
+  sendInputEvents([
+      { type: "mousePress", x: 10, y: 20 },
+      { type: "mouseRelease", x: 10, y: 20 },
+      { type: "keyPress", key: Qt.Key_A, text: "a" },
+      { type: "keyRelease", key: Qt.Key_A, text: "a" }
+  ]);
+  \endcode
+
+  \sa replayInputEvents()
+*/
+void WPEQtView::sendInputEvents(const QVariantList& events)
+{
+    if (!m_backend)
+        return;
+
+    for (const auto& event : events)
+        m_backend->injectInputEvent(event.toMap());
+}
+
+/*!
+  \qmlmethod void WPEView::replayInputEvents(list events, real speed)
+
+  Replays recorded input \a events, keeping the intervals between their
+  \e time stamps divided by \a speed. A \a speed of zero or less dispatches
+  all events as fast as possible. The events use the same format as
+  sendInputEvents(). The inputReplayFinished() signal is emitted once the
+  last event has been dispatched.
+
+  \sa stopInputReplay()
+*/
+void WPEQtView::replayInputEvents(const QVariantList& events, qreal speed)
+{
+    stopInputReplay();
+
+    m_replayEvents = events;
+    m_replaySpeed = speed;
+    m_replayStartTime = events.isEmpty() ? 0 : events.first().toMap().value(QStringLiteral("time")).toLongLong();
+    m_replayClock.start();
+    replayPendingInputEvents();
+}
+
+/*!
+  \qmlmethod void WPEView::stopInputReplay()
+
+  Stops replaying the input events passed to replayInputEvents().
+*/
+void WPEQtView::stopInputReplay()
+{
+    m_replayTimer.stop();
+    m_replayEvents.clear();
+    m_replayIndex = 0;
+}
+
+void WPEQtView::replayPendingInputEvents()
+{
+    qint64 elapsed = m_replayClock.elapsed();
+    while (m_replayIndex < m_replayEvents.size()) {
+        QVariantMap event = m_replayEvents.at(m_replayIndex).toMap();
+        qint64 due = 0;
+        if (m_replaySpeed > 0)
+            due = (event.value(QStringLiteral("time")).toLongLong() - m_replayStartTime) / m_replaySpeed;
+        if (due > elapsed) {
+            m_replayTimer.start(int(due - elapsed));
+            return;
+        }
+
+        if (m_backend)
+            m_backend->injectInputEvent(event);
+        m_replayIndex++;
+    }
+
+    stopInputReplay();
+    Q_EMIT inputReplayFinished();
+}
+
+/*!
+  \qmlmethod object WPEView::inputStatistics()
+
+  Returns counters of the input coalescing: the number of motion and scroll
+  events received, how many of them were merged into a later one, the number
+  of per-frame flushes and the average and maximum time in microseconds
+  between queuing an event and dispatching it to WebKit.
+*/
+QVariantMap WPEQtView::inputStatistics() const
+{
+    QVariantMap statistics;
+    if (!m_backend)
+        return statistics;
+
+    const auto& stats = m_backend->inputStatistics();
+    statistics.insert(QStringLiteral("motionEvents"), stats.motionEvents);
+    statistics.insert(QStringLiteral("coalescedMotionEvents"), stats.coalescedMotionEvents);
+    statistics.insert(QStringLiteral("axisEvents"), stats.axisEvents);
+    statistics.insert(QStringLiteral("coalescedAxisEvents"), stats.coalescedAxisEvents);
+    statistics.insert(QStringLiteral("flushes"), stats.flushes);
+    statistics.insert(QStringLiteral("averageFlushLatency"), stats.flushes ? stats.totalFlushLatency / qint64(stats.flushes) : 0);
+    statistics.insert(QStringLiteral("maxFlushLatency"), stats.maxFlushLatency);
+    return statistics;
+}
+
 void WPEQtView::mouseMoveEvent(QMouseEvent* event)
 {
     if (m_backend)
@@ -571,6 +2020,86 @@ void WPEQtView::touchEvent(QTouchEvent* event)
         m_backend->dispatchTouchEvent(event);
 }
 
+/*!
+  \qmlmethod object WPEView::webKitThreadStatistics()
+
+  Returns, when WebKit runs on its own thread, the number of \c commands
+  sent to it and the \c results delivered back to the GUI thread, each
+  with the average and maximum time in microseconds they waited in their
+  queue, and the number of \c batches the results were delivered in.
+  Returns an empty object when WebKit runs on the GUI thread.
+
+  Together with inputStatistics() this allows comparing both modes.
+*/
+QVariantMap WPEQtView::webKitThreadStatistics() const
+{
+    if (auto* thread = WPEQtWebKitThread::instance())
+        return thread->statistics();
+
+    return QVariantMap();
+}
+
+/*!
+  \qmlmethod object WPEView::frameStatistics()
+
+  Returns how frames rendered by WebKit are handed back to it. Each frame
+  is released once a GPU fence tells the scene graph is done sampling it;
+  \c fence is \c nativeFence or \c fence depending on the EGL extension
+  used, or \c none when the driver supports neither and frames are released
+  relying on implicit synchronization.
+
+  The object also holds whether the view is drawn \c opaque, without
+  blending, the number of \c frames displayed, how many of them were
+  \c fencedFrames, and the number of \c stalls, times the render thread
+  had to wait for a fence, with their \c averageStall and \c maxStall
+  duration in microseconds.
+*/
+QVariantMap WPEQtView::frameStatistics() const
+{
+    QVariantMap statistics;
+    if (!m_backend)
+        return statistics;
+
+    const auto stats = m_backend->frameStatistics();
+    switch (m_backend->fenceType()) {
+    case EGL_SYNC_NATIVE_FENCE_ANDROID:
+        statistics.insert(QStringLiteral("fence"), QStringLiteral("nativeFence"));
+        break;
+    case EGL_SYNC_FENCE_KHR:
+        statistics.insert(QStringLiteral("fence"), QStringLiteral("fence"));
+        break;
+    default:
+        statistics.insert(QStringLiteral("fence"), QStringLiteral("none"));
+        break;
+    }
+    statistics.insert(QStringLiteral("opaque"), isOpaque());
+    statistics.insert(QStringLiteral("frames"), stats.frames);
+    statistics.insert(QStringLiteral("fencedFrames"), stats.fencedFrames);
+    statistics.insert(QStringLiteral("stalls"), stats.stalls);
+    statistics.insert(QStringLiteral("averageStall"), stats.stalls ? stats.totalStallTime / qint64(stats.stalls) : 0);
+    statistics.insert(QStringLiteral("maxStall"), stats.maxStallTime);
+    return statistics;
+}
+
+/*!
+  \qmlmethod object WPEView::eventLoopStatistics()
+
+  Returns how the GLib main context WebKit runs on is dispatched, as
+  \c integration: \c qtGlibDispatcher when Qt's GLib event dispatcher
+  does it, \c qtEventLoopPump when the plugin pumps it from the Qt event
+  loop because Qt uses another dispatcher, for instance with QT_NO_GLIB
+  set, or \c webKitThread when WebKit runs on its own thread.
+
+  While at least one WPEView exists, a probe source is dispatched every
+  100 ms. The object also holds the number of \c probes, their
+  \c averageLatency and \c maxLatency in microseconds past their due time,
+  and the number of \c stalls, probes late by 50 ms or more. Stalls mean WebKit callbacks are being starved.
+*/
+QVariantMap WPEQtView::eventLoopStatistics() const
+{
+    return WPEQtMainContext::statistics();
+}
+
 void WPEQtView::inputMethodEvent(QInputMethodEvent* event)
 {
     if (m_imContext)
@@ -22,16 +22,35 @@
 
 #include "config.h"
 
+#include "WPEQtPrefetchHints.h"
+#include "WPEQtUrlMatcher.h"
+#include "WPEQtWebsiteData.h"
+#include <QColor>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QPointer>
 #include <QQmlEngine>
 #include <QQuickItem>
+#include <QSet>
+#include <QTimer>
 #include <QUrl>
+#include <QVector>
 #include <memory>
 #include <wpe/webkit.h>
 #include <wtf/glib/GRefPtr.h>
 
+class WPEQtBridge;
+class WPEQtContentFilters;
+class WPEQtResourceTiming;
+class WPEQtUserContent;
 class WPEQtViewBackend;
 class WPEQtViewLoadRequest;
 
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+Q_MOC_INCLUDE("WPEQtViewLoadRequest.h")
+#endif
+
 class WPEQtView : public QQuickItem {
     Q_OBJECT
     Q_DISABLE_COPY(WPEQtView)
@@ -41,14 +60,37 @@ class WPEQtView : public QQuickItem {
     Q_PROPERTY(QString title READ title NOTIFY titleChanged)
     Q_PROPERTY(bool canGoBack READ canGoBack NOTIFY loadingChanged)
     Q_PROPERTY(bool canGoForward READ canGoForward NOTIFY loadingChanged)
+    Q_PROPERTY(QStringList messageHandlers READ messageHandlers WRITE setMessageHandlers NOTIFY messageHandlersChanged)
+    Q_PROPERTY(QVariantList userScripts READ userScripts WRITE setUserScripts NOTIFY userScriptsChanged)
+    Q_PROPERTY(QVariantList userStyleSheets READ userStyleSheets WRITE setUserStyleSheets NOTIFY userStyleSheetsChanged)
+    Q_PROPERTY(QVariantList contentFilters READ contentFilters WRITE setContentFilters NOTIFY contentFiltersChanged)
+    Q_PROPERTY(WPEQtWebsiteData* websiteData READ websiteData WRITE setWebsiteData NOTIFY websiteDataChanged)
+    Q_PROPERTY(bool resourceTimingEnabled READ isResourceTimingEnabled WRITE setResourceTimingEnabled NOTIFY resourceTimingEnabledChanged)
+    Q_PROPERTY(QStringList allowedUrls READ allowedUrls WRITE setAllowedUrls NOTIFY allowedUrlsChanged)
+    Q_PROPERTY(QColor backgroundColor READ backgroundColor WRITE setBackgroundColor NOTIFY backgroundColorChanged)
+    Q_PROPERTY(qreal zoomFactor READ zoomFactor WRITE setZoomFactor NOTIFY zoomFactorChanged)
     Q_ENUMS(LoadStatus)
+    Q_ENUMS(InjectionTime)
+    Q_ENUMS(StyleSheetLevel)
 
 public:
     enum LoadStatus {
         LoadStartedStatus,
         LoadStoppedStatus,
         LoadSucceededStatus,
-        LoadFailedStatus
+        LoadFailedStatus,
+        LoadCommittedStatus,
+        LoadRedirectedStatus
+    };
+
+    enum InjectionTime {
+        DocumentStart,
+        DocumentEnd
+    };
+
+    enum StyleSheetLevel {
+        UserLevel,
+        AuthorLevel
     };
 
     WPEQtView(QQuickItem* parent = nullptr);
@@ -56,6 +98,7 @@ public:
     QSGNode* updatePaintNode(QSGNode*, UpdatePaintNodeData*) final;
 
     void triggerUpdate() { QMetaObject::invokeMethod(this, "update"); };
+    void scheduleFlush();
 
     QUrl url() const;
     void setUrl(const QUrl&);
@@ -64,6 +107,38 @@ public:
     bool canGoBack() const;
     bool isLoading() const;
     bool canGoForward() const;
+    QStringList messageHandlers() const;
+    void setMessageHandlers(const QStringList&);
+    QVariantList userScripts() const;
+    void setUserScripts(const QVariantList&);
+    QVariantList userStyleSheets() const;
+    void setUserStyleSheets(const QVariantList&);
+    QVariantList contentFilters() const;
+    void setContentFilters(const QVariantList&);
+    WPEQtWebsiteData* websiteData() const;
+    void setWebsiteData(WPEQtWebsiteData*);
+    bool isResourceTimingEnabled() const;
+    void setResourceTimingEnabled(bool);
+    QStringList allowedUrls() const;
+    void setAllowedUrls(const QStringList&);
+    QColor backgroundColor() const;
+    void setBackgroundColor(const QColor&);
+    qreal zoomFactor() const;
+    void setZoomFactor(qreal);
+
+    Q_INVOKABLE QVariantMap inputStatistics() const;
+    Q_INVOKABLE QVariantMap webKitThreadStatistics() const;
+    Q_INVOKABLE QVariantMap eventLoopStatistics() const;
+    Q_INVOKABLE QVariantMap frameStatistics() const;
+    Q_INVOKABLE QVariantMap contentFilterStatistics() const;
+    Q_INVOKABLE QVariantMap navigationStatistics() const;
+    Q_INVOKABLE QVariantMap prefetchStatistics() const;
+    Q_INVOKABLE QString resourceTimingHar() const;
+    Q_INVOKABLE QVariantMap resourceTimingStatistics() const;
+    Q_INVOKABLE void registerUriScheme(const QString& scheme, const QUrl& directory);
+    Q_INVOKABLE bool registerAssetPack(const QString& scheme, const QUrl& pack);
+    Q_INVOKABLE void registerObject(const QString& name, QObject*);
+    Q_INVOKABLE void unregisterObject(const QString& name);
 
 public Q_SLOTS:
     void goBack();
@@ -71,15 +146,43 @@ public Q_SLOTS:
     void reload();
     void stop();
     void loadHtml(const QString& html, const QUrl& baseUrl = QUrl());
+    void loadData(const QByteArray& data, const QString& mimeType = QStringLiteral("text/html"),
+        const QString& encoding = QStringLiteral("UTF-8"), const QUrl& baseUrl = QUrl());
     void runJavaScript(const QString& script, const QJSValue& callback = QJSValue());
+    void runJavaScriptBatch(const QStringList& scripts, const QJSValue& callback = QJSValue());
+    int compileJavaScript(const QString& function);
+    void runCompiledJavaScript(int handle, const QVariantList& arguments = QVariantList(), const QJSValue& callback = QJSValue());
+    void releaseCompiledJavaScript(int handle);
+    void postMessage(const QString& name, const QVariant& payload);
+    void prefetchDns(const QList<QUrl>& urls);
+    void preconnect(const QList<QUrl>& urls);
+    void prefetch(const QList<QUrl>& urls);
+    void sendInputEvents(const QVariantList& events);
+    void replayInputEvents(const QVariantList& events, qreal speed = 1.0);
+    void stopInputReplay();
+    void beginPinchZoom();
+    void updatePinchZoom(qreal scale, const QPointF& center);
+    void endPinchZoom();
 
 Q_SIGNALS:
     void webViewCreated();
     void urlChanged();
     void titleChanged();
-    void loadingChanged(WPEQtViewLoadRequest* loadRequest);
+    void loadingChanged(const WPEQtViewLoadRequest& loadRequest);
     void loadProgressChanged();
     void webProcessCrashed();
+    void inputReplayFinished();
+    void messageHandlersChanged();
+    void userScriptsChanged();
+    void userStyleSheetsChanged();
+    void contentFiltersChanged();
+    void websiteDataChanged();
+    void resourceTimingEnabledChanged();
+    void allowedUrlsChanged();
+    void backgroundColorChanged();
+    void zoomFactorChanged();
+    void navigationBlocked(const QUrl& url);
+    void messageReceived(const QString& name, const QVariant& payload);
 
 protected:
     bool errorOccured() const { return m_errorOccured; };
@@ -111,6 +214,9 @@ protected:
 private Q_SLOTS:
     void configureWindow();
     void createWebView();
+    void flushPendingUpdates();
+    void replayPendingInputEvents();
+    void deliverMessages();
 
 private:
     static void notifyUrlChangedCallback(WPEQtView*);
@@ -120,15 +226,106 @@ private:
     static void notifyLoadFailedCallback(WebKitWebView*, WebKitLoadEvent, const gchar* failingURI, GError*, WPEQtView*);
     static void notifyWebProcessTerminatedCallback(WebKitWebView*, WebKitWebProcessTerminationReason, WPEQtView*);
     static void *createRequested(WebKitWebView*, WebKitNavigationAction*, WPEQtView*);
+    static gboolean decidePolicyCallback(WebKitWebView*, WebKitPolicyDecision*, WebKitPolicyDecisionType, WPEQtView*);
+#ifndef USE_2022_GLIB_API
+    static void resourceLoadStartedCallback(WebKitWebView*, WebKitWebResource*, WebKitURIRequest*, WPEQtView*);
+#endif
+    static void scriptMessageReceivedCallback(WebKitUserContentManager*, gpointer message, gpointer userData);
+
+    void registerMessageHandler(const QString&);
+    void unregisterMessageHandler(const QString&);
+    void scheduleMessageDelivery();
+    void addResourceHints(WPEQtPrefetchHints::Type, const QList<QUrl>&);
+    void notifyPropertyChanged(unsigned notification);
+    void loadUrl(const QUrl&);
+    void emitLoadingChanged(const QUrl&, LoadStatus, const QString& errorString = QString());
+    void installBridge();
+    void applyBackgroundColor();
+    void applyZoomFactor();
+    void updateScaleFactor();
+    bool isOpaque() const;
 
     GRefPtr<WebKitWebView> m_webView;
+    GRefPtr<WebKitUserContentManager> m_userContentManager;
     QUrl m_url;
-    QString m_html;
-    QUrl m_baseUrl;
+    // Data of a loadData() call made before the web view exists.
+    QByteArray m_pendingData;
+    QString m_pendingMimeType;
+    QString m_pendingEncoding;
+    QUrl m_pendingBaseUrl;
     QSizeF m_size;
+    QPointer<QQuickWindow> m_window;
     WPEQtViewBackend* m_backend { nullptr };
+    QColor m_backgroundColor { Qt::white };
+    qreal m_zoomFactor { 1 };
+
+    // During a pinch the last frame is scaled by the scene graph, WebKit
+    // rasterizes again once the gesture ends.
+    bool m_pinching { false };
+    qreal m_pinchScale { 1 };
+    QPointF m_pinchCenter;
+    // The scaled frame is kept until WebKit displays a newer one.
+    bool m_pinchSettling { false };
+    quint64 m_pinchEndFrame { 0 };
     bool m_errorOccured { false };
+    qint64 m_loadStartTime { 0 };
+    QElapsedTimer m_loadTimer;
+    bool m_flushScheduled { false };
+
+    // State mirrored from WebKit, change notifications are emitted at most
+    // once per frame.
+    enum PropertyNotification {
+        UrlNotification = 1 << 0,
+        TitleNotification = 1 << 1,
+        LoadProgressNotification = 1 << 2
+    };
+    QUrl m_currentUrl;
+    QString m_title;
+    int m_loadProgress { 0 };
+    unsigned m_pendingNotifications { 0 };
+    // Only read when WebKit runs on its own thread and can not be queried.
+    bool m_canGoBack { false };
+    bool m_canGoForward { false };
+    bool m_isLoading { false };
     WebKitInputMethodContext *m_imContext = nullptr;
 
+    QHash<int, QByteArray> m_compiledScripts;
+    QSet<int> m_definedScripts;
+    // Bumped when a page load drops the functions defined in the page.
+    unsigned m_scriptGeneration { 0 };
+    int m_nextScriptHandle { 1 };
+
+    QStringList m_messageHandlers;
+    QHash<QString, gulong> m_messageHandlerIds;
+    QVector<QPair<QString, QVariant>> m_receivedMessages;
+    QJsonArray m_postedMessages;
+    bool m_messageDeliveryScheduled { false };
+    WPEQtBridge* m_bridge { nullptr };
+
+    std::unique_ptr<WPEQtUserContent> m_userContent;
+    QVariantList m_userScripts;
+    QVariantList m_userStyleSheets;
+
+    std::shared_ptr<WPEQtContentFilters> m_contentFilters;
+    QVariantList m_contentFilterList;
+
+    QPointer<WPEQtWebsiteData> m_websiteData;
+
+    WPEQtUrlMatcher m_urlMatcher;
+    QVector<quint64> m_ruleHits;
+    quint64 m_allowedNavigations { 0 };
+    quint64 m_blockedNavigations { 0 };
+
+    WPEQtPrefetchHints m_prefetchHints;
+    std::shared_ptr<WPEQtResourceTiming> m_resourceTiming;
+
+    QVariantList m_replayEvents;
+    int m_replayIndex { 0 };
+    qreal m_replaySpeed { 1 };
+    qint64 m_replayStartTime { 0 };
+    QElapsedTimer m_replayClock;
+    QTimer m_replayTimer;
+
+    friend class WPEQtBridge;
     friend class WPEQtViewBackend;
 };
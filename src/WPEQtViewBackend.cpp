@@ -22,9 +22,13 @@
 #include "WPEQtViewBackend.h"
 
 #include "WPEQtView.h"
+#include "WPEQtWebKitThread.h"
 #include <QGuiApplication>
+#include <QMutexLocker>
 #include <QOpenGLFunctions>
 #include <QtGlobal>
+#include <algorithm>
+#include <utility>
 
 static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC imageTargetTexture2DOES;
 
@@ -38,40 +42,22 @@ std::unique_ptr<WPEQtViewBackend> WPEQtViewBackend::create(const QSizeF& size, Q
 
     eglInitialize(eglDisplay, nullptr, nullptr);
 
-    if (!eglBindAPI(EGL_OPENGL_ES_API) || !wpe_fdo_initialize_for_egl_display(eglDisplay))
+    // The fdo server attaches its sources to the context of the thread
+    // running WebKit.
+    bool initialized = false;
+    WPEQtWebKitThread::invokeAndWait([&] {
+        initialized = wpe_fdo_initialize_for_egl_display(eglDisplay);
+    });
+    if (!initialized)
         return nullptr;
 
-    static const EGLint configAttributes[13] = {
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RED_SIZE, 1,
-        EGL_GREEN_SIZE, 1,
-        EGL_BLUE_SIZE, 1,
-        EGL_ALPHA_SIZE, 1,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_NONE
-    };
-
-    EGLint count = 0;
-    if (!eglGetConfigs(eglDisplay, nullptr, 0, &count) || count < 1)
-        return nullptr;
-
-    EGLConfig eglConfig;
-    EGLint matched = 0;
-    EGLContext eglContext = nullptr;
-    if (eglChooseConfig(eglDisplay, configAttributes, &eglConfig, 1, &matched) && !!matched) {
-        static const EGLint contextAttributes[3] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
-        eglContext = eglCreateContext(eglDisplay, eglConfig, nullptr, contextAttributes);
-    }
-
-    if (!eglContext)
-        return nullptr;
-
-    return std::make_unique<WPEQtViewBackend>(size, eglDisplay, eglContext, context, view);
+    // Frames are bound in the scene graph's own context, the backend needs
+    // none of its own.
+    return std::make_unique<WPEQtViewBackend>(size, eglDisplay, view);
 }
 
-WPEQtViewBackend::WPEQtViewBackend(const QSizeF& size, EGLDisplay display, EGLContext eglContext, QPointer<QOpenGLContext> context, QPointer<WPEQtView> view)
+WPEQtViewBackend::WPEQtViewBackend(const QSizeF& size, EGLDisplay display, QPointer<WPEQtView> view)
     : m_eglDisplay(display)
-    , m_eglContext(eglContext)
     , m_view(view)
     , m_size(size)
 {
@@ -79,39 +65,12 @@ WPEQtViewBackend::WPEQtViewBackend(const QSizeF& size, EGLDisplay display, EGLCo
 
     imageTargetTexture2DOES = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(eglGetProcAddress("glEGLImageTargetTexture2DOES"));
 
-    static const char* vertexShaderSource =
-        "attribute vec2 pos;\n"
-        "attribute vec2 texture;\n"
-        "varying vec2 v_texture;\n"
-        "void main() {\n"
-        "  v_texture = texture;\n"
-        "  gl_Position = vec4(pos, 0, 1);\n"
-        "}\n";
-    static const char* fragmentShaderSource =
-        "precision mediump float;\n"
-        "uniform sampler2D u_texture;\n"
-        "varying vec2 v_texture;\n"
-        "void main() {\n"
-        "  gl_FragColor = texture2D(u_texture, v_texture);\n"
-        "}\n";
-
-    QOpenGLFunctions* glFunctions = context->functions();
-    GLuint vertexShader = glFunctions->glCreateShader(GL_VERTEX_SHADER);
-    glFunctions->glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glFunctions->glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glFunctions->glCreateShader(GL_FRAGMENT_SHADER);
-    glFunctions->glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
-    glFunctions->glCompileShader(fragmentShader);
-
-    m_program = glFunctions->glCreateProgram();
-    glFunctions->glAttachShader(m_program, vertexShader);
-    glFunctions->glAttachShader(m_program, fragmentShader);
-    glFunctions->glLinkProgram(m_program);
-
-    glFunctions->glBindAttribLocation(m_program, 0, "pos");
-    glFunctions->glBindAttribLocation(m_program, 1, "texture");
-    m_textureUniform = glFunctions->glGetUniformLocation(m_program, "u_texture");
+    // Native fences are backed by a kernel sync file, which drivers can wait
+    // on without polling.
+    if (epoxy_has_egl_extension(m_eglDisplay, "EGL_ANDROID_native_fence_sync"))
+        m_fenceType = EGL_SYNC_NATIVE_FENCE_ANDROID;
+    else if (epoxy_has_egl_extension(m_eglDisplay, "EGL_KHR_fence_sync"))
+        m_fenceType = EGL_SYNC_FENCE_KHR;
 
     static struct wpe_view_backend_exportable_fdo_egl_client exportableClient = {
         // export_egl_image
@@ -124,30 +83,32 @@ WPEQtViewBackend::WPEQtViewBackend(const QSizeF& size, EGLDisplay display, EGLCo
         nullptr, nullptr, nullptr
     };
 
-    m_exportable = wpe_view_backend_exportable_fdo_egl_create(&exportableClient, this, m_size.width(), m_size.height());
-
-    wpe_view_backend_add_activity_state(backend(), wpe_view_activity_state_visible | wpe_view_activity_state_focused | wpe_view_activity_state_in_window);
-
-    m_surface.setFormat(context->format());
-    m_surface.create();
+    WPEQtWebKitThread::invokeAndWait([this] {
+        m_exportable = wpe_view_backend_exportable_fdo_egl_create(&exportableClient, this, m_size.width(), m_size.height());
+        wpe_view_backend_add_activity_state(backend(), wpe_view_activity_state_visible | wpe_view_activity_state_focused | wpe_view_activity_state_in_window);
+    });
 }
 
 WPEQtViewBackend::~WPEQtViewBackend()
 {
+    for (auto* frame : { &m_displayedFrame, &m_retiredFrame }) {
+        if (frame->fence != EGL_NO_SYNC_KHR)
+            eglDestroySyncKHR(m_eglDisplay, frame->fence);
+        if (frame->image)
+            wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(m_exportable, frame->image);
+    }
     if (m_lockedImage)
         wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(m_exportable, m_lockedImage);
-    if (m_lockedImageOld)
-        wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(m_exportable, m_lockedImageOld);
 
     wpe_view_backend_exportable_fdo_destroy(m_exportable);
-    eglDestroyContext(m_eglDisplay, m_eglContext);
 }
 
 void WPEQtViewBackend::setScaleFactor(float factor)
 {
     m_scale = factor;
-    auto backend = wpe_view_backend_exportable_fdo_get_view_backend(m_exportable);
-    wpe_view_backend_dispatch_set_device_scale_factor(backend, m_scale);
+    WPEQtWebKitThread::invoke([viewBackend = backend(), factor] {
+        wpe_view_backend_dispatch_set_device_scale_factor(viewBackend, factor);
+    });
 }
 
 void WPEQtViewBackend::resize(const QSizeF& newSize)
@@ -156,83 +117,129 @@ void WPEQtViewBackend::resize(const QSizeF& newSize)
         return;
 
     m_size = newSize;
-    wpe_view_backend_dispatch_set_size(backend(), m_size.width(), m_size.height());
+    WPEQtWebKitThread::invoke([viewBackend = backend(), width = uint32_t(m_size.width()), height = uint32_t(m_size.height())] {
+        wpe_view_backend_dispatch_set_size(viewBackend, width, height);
+    });
 }
 
-GLuint WPEQtViewBackend::texture(QOpenGLContext* context)
+WPEQtViewBackend::FrameStatistics WPEQtViewBackend::frameStatistics() const
 {
-    if (!m_lockedImage && m_lockedImageOld)
-        std::swap(m_lockedImage, m_lockedImageOld);
+    QMutexLocker locker(&m_imageLock);
+    return m_frameStatistics;
+}
 
-    if (!m_lockedImage || !hasValidSurface())
-        return 0;
+// Called while the scene graph synchronizes, with its context current. The
+// exported image is sampled straight from the scene graph's own rendering.
+GLuint WPEQtViewBackend::texture(QOpenGLContext* context)
+{
+    struct wpe_fdo_egl_exported_image* image;
+    {
+        QMutexLocker locker(&m_imageLock);
+        image = std::exchange(m_lockedImage, nullptr);
+    }
 
-    QSurface *oldSurface = context->surface();
-    context->makeCurrent(&m_surface);
+    // The retired image was last sampled by the frame rendered before the
+    // previous synchronization, its fence tells when that frame is done.
+    if (m_retiredFrame.image)
+        releaseRetiredFrame();
+
+    if (image) {
+        if (m_displayedFrame.image) {
+            m_retiredFrame = m_displayedFrame;
+            // Everything submitted so far, including the last frame that
+            // sampled the retired image, comes before this fence.
+            if (m_fenceType != EGL_NONE)
+                m_retiredFrame.fence = eglCreateSyncKHR(m_eglDisplay, m_fenceType, nullptr);
+        }
+        m_displayedFrame = { image, EGL_NO_SYNC_KHR };
+        // The texture takes the storage of each image, a resize or a new
+        // scale factor reallocates it along with WebKit's buffers.
+        m_textureSize = QSize(wpe_fdo_egl_exported_image_get_width(image), wpe_fdo_egl_exported_image_get_height(image));
+
+        QOpenGLFunctions* glFunctions = context->functions();
+        if (!m_textureId) {
+            glFunctions->glGenTextures(1, &m_textureId);
+            glFunctions->glBindTexture(GL_TEXTURE_2D, m_textureId);
+            glFunctions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glFunctions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFunctions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glFunctions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
 
-    QOpenGLFunctions* glFunctions = context->functions();
-    if (!m_textureId) {
-        glFunctions->glGenTextures(1, &m_textureId);
         glFunctions->glBindTexture(GL_TEXTURE_2D, m_textureId);
-        glFunctions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glFunctions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFunctions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glFunctions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFunctions->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_size.width(), m_size.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        imageTargetTexture2DOES(GL_TEXTURE_2D, wpe_fdo_egl_exported_image_get_egl_image(image));
         glFunctions->glBindTexture(GL_TEXTURE_2D, 0);
-    }
-
-    glFunctions->glClearColor(1, 0, 0, 1);
-    glFunctions->glClear(GL_COLOR_BUFFER_BIT);
-
-    glFunctions->glUseProgram(m_program);
-
-    glFunctions->glActiveTexture(GL_TEXTURE0);
-    glFunctions->glBindTexture(GL_TEXTURE_2D, m_textureId);
-    imageTargetTexture2DOES(GL_TEXTURE_2D, wpe_fdo_egl_exported_image_get_egl_image(m_lockedImage));
-    glFunctions->glUniform1i(m_textureUniform, 0);
-
-    static const GLfloat vertices[4][2] = {
-        { -1.0, 1.0  },
-        {  1.0, 1.0  },
-        { -1.0, -1.0 },
-        {  1.0, -1.0 },
-    };
-
-    static const GLfloat texturePos[4][2] = {
-        { 0, 0 },
-        { 1, 0 },
-        { 0, 1 },
-        { 1, 1 },
-    };
 
-    glFunctions->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, vertices);
-    glFunctions->glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texturePos);
+        {
+            QMutexLocker locker(&m_imageLock);
+            m_frameStatistics.frames++;
+            if (m_retiredFrame.fence != EGL_NO_SYNC_KHR)
+                m_frameStatistics.fencedFrames++;
+        }
 
-    glFunctions->glEnableVertexAttribArray(0);
-    glFunctions->glEnableVertexAttribArray(1);
+        WPEQtWebKitThread::invoke([exportable = m_exportable] {
+            wpe_view_backend_exportable_fdo_dispatch_frame_complete(exportable);
+        });
 
-    glFunctions->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        // WebKit may be out of buffers until the retired image is back, make
+        // sure there is a next synchronization to release it.
+        if (m_retiredFrame.image && m_view)
+            m_view->triggerUpdate();
+    }
 
-    glFunctions->glDisableVertexAttribArray(0);
-    glFunctions->glDisableVertexAttribArray(1);
+    return m_displayedFrame.image ? m_textureId : 0;
+}
 
-    wpe_view_backend_exportable_fdo_dispatch_frame_complete(m_exportable);
-    if (m_lockedImageOld)
-        wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(m_exportable, m_lockedImageOld);
-    m_lockedImageOld = m_lockedImage;
-    m_lockedImage = nullptr;
+void WPEQtViewBackend::releaseRetiredFrame()
+{
+    if (m_retiredFrame.fence != EGL_NO_SYNC_KHR) {
+        // Usually signaled already, one frame went by since it was created.
+        if (eglClientWaitSyncKHR(m_eglDisplay, m_retiredFrame.fence, 0, 0) != EGL_CONDITION_SATISFIED_KHR) {
+            QElapsedTimer timer;
+            timer.start();
+            eglClientWaitSyncKHR(m_eglDisplay, m_retiredFrame.fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+            const qint64 stallTime = timer.nsecsElapsed() / 1000;
+
+            QMutexLocker locker(&m_imageLock);
+            m_frameStatistics.stalls++;
+            m_frameStatistics.totalStallTime += stallTime;
+            m_frameStatistics.maxStallTime = std::max(m_frameStatistics.maxStallTime, stallTime);
+        }
+        eglDestroySyncKHR(m_eglDisplay, m_retiredFrame.fence);
+    }
 
-    context->makeCurrent(oldSurface);
-    return m_textureId;
+    WPEQtWebKitThread::invoke([exportable = m_exportable, releasedImage = m_retiredFrame.image] {
+        wpe_view_backend_exportable_fdo_egl_dispatch_release_exported_image(exportable, releasedImage);
+    });
+    m_retiredFrame = { };
 }
 
 void WPEQtViewBackend::displayImage(struct wpe_fdo_egl_exported_image* image)
 {
-    RELEASE_ASSERT(!m_lockedImage);
-    m_lockedImage = image;
-    if (m_view)
-        m_view->triggerUpdate();
+    {
+        QMutexLocker locker(&m_imageLock);
+        RELEASE_ASSERT(!m_lockedImage);
+        m_lockedImage = image;
+    }
+    // This runs on the WebKit thread, where the view can be destroyed at any
+    // time. The guard is only checked once the update reaches the GUI thread.
+    WPEQtWebKitThread::deliver(m_view, [view = m_view] {
+        view->triggerUpdate();
+    });
+}
+
+static uint32_t wpeKeyboardModifiers(Qt::KeyboardModifiers qtModifiers)
+{
+    uint32_t modifiers = 0;
+    if (qtModifiers & Qt::ShiftModifier)
+        modifiers |= wpe_input_keyboard_modifier_shift;
+    if (qtModifiers & Qt::ControlModifier)
+        modifiers |= wpe_input_keyboard_modifier_control;
+    if (qtModifiers & Qt::MetaModifier)
+        modifiers |= wpe_input_keyboard_modifier_meta;
+    if (qtModifiers & Qt::AltModifier)
+        modifiers |= wpe_input_keyboard_modifier_alt;
+    return modifiers;
 }
 
 uint32_t WPEQtViewBackend::modifiers() const
@@ -243,6 +250,60 @@ uint32_t WPEQtViewBackend::modifiers() const
     return mask;
 }
 
+void WPEQtViewBackend::notePendingInput()
+{
+    // Motion and axis events are forwarded to WebKit once per frame, anything
+    // else (buttons, keys, touch presses) flushes them first to keep ordering.
+    if (!hasPendingInput())
+        m_pendingInputTimer.start();
+
+    if (m_view)
+        m_view->scheduleFlush();
+}
+
+void WPEQtViewBackend::queuePointerMotion(const struct wpe_input_pointer_event& event)
+{
+    m_inputStatistics.motionEvents++;
+    if (m_hasPendingMotion)
+        m_inputStatistics.coalescedMotionEvents++;
+
+    notePendingInput();
+    m_pendingMotion = event;
+    m_hasPendingMotion = true;
+}
+
+void WPEQtViewBackend::flushPendingInput()
+{
+    if (!hasPendingInput())
+        return;
+
+    if (m_hasPendingMotion) {
+        m_hasPendingMotion = false;
+        dispatchPointerEvent(m_pendingMotion);
+    }
+
+    // WebKit reports the point given by the event id as changed and the
+    // others as stationary, every point that moved gets its own event.
+    for (size_t i = 0; m_movedTouchPoints; ++i) {
+        if (!(m_movedTouchPoints & (1u << i)))
+            continue;
+        m_movedTouchPoints &= ~(1u << i);
+        const auto& point = m_touchPoints[i];
+        if (point.type == wpe_input_touch_event_type_motion)
+            dispatchTouchPoints(wpe_input_touch_event_type_motion, point.id, point.time);
+    }
+
+    if (m_hasPendingAxis) {
+        m_hasPendingAxis = false;
+        dispatchAxisEvent(m_pendingAxis);
+    }
+
+    qint64 latency = m_pendingInputTimer.nsecsElapsed() / 1000;
+    m_inputStatistics.flushes++;
+    m_inputStatistics.totalFlushLatency += latency;
+    m_inputStatistics.maxFlushLatency = std::max(m_inputStatistics.maxFlushLatency, latency);
+}
+
 void WPEQtViewBackend::dispatchHoverEnterEvent(QHoverEvent*)
 {
     m_hovering = true;
@@ -251,6 +312,7 @@ void WPEQtViewBackend::dispatchHoverEnterEvent(QHoverEvent*)
 
 void WPEQtViewBackend::dispatchHoverLeaveEvent(QHoverEvent*)
 {
+    flushPendingInput();
     m_hovering = false;
 }
 
@@ -262,9 +324,9 @@ void WPEQtViewBackend::dispatchHoverMoveEvent(QHoverEvent* event)
     uint32_t state = !!m_mousePressedButton;
     struct wpe_input_pointer_event wpeEvent = { wpe_input_pointer_event_type_motion,
         static_cast<uint32_t>(event->timestamp()),
-        event->pos().x() * m_scale, event->pos().y() * m_scale,
+        int(event->pos().x() * m_scale), int(event->pos().y() * m_scale),
         m_mousePressedButton, state, modifiers() };
-    wpe_view_backend_dispatch_pointer_event(backend(), &wpeEvent);
+    queuePointerMotion(wpeEvent);
 }
 
 void WPEQtViewBackend::dispatchMouseMoveEvent(QMouseEvent* event)
@@ -274,57 +336,54 @@ void WPEQtViewBackend::dispatchMouseMoveEvent(QMouseEvent* event)
         static_cast<uint32_t>(event->timestamp()),
         int(event->pos().x() * m_scale), int(event->pos().y() * m_scale),
         m_mousePressedButton, state, modifiers() };
-    wpe_view_backend_dispatch_pointer_event(backend(), &wpeEvent);
+    queuePointerMotion(wpeEvent);
 }
 
-void WPEQtViewBackend::dispatchMousePressEvent(QMouseEvent* event)
+static uint32_t wpeButton(Qt::MouseButton qtButton, uint32_t* modifier)
 {
-    uint32_t button = 0;
-    uint32_t modifier = 0;
-    switch (event->button()) {
+    switch (qtButton) {
     case Qt::LeftButton:
-        button = 1;
-        modifier = wpe_input_pointer_modifier_button1;
-        break;
+        *modifier = wpe_input_pointer_modifier_button1;
+        return 1;
     case Qt::RightButton:
-        button = 2;
-        modifier = wpe_input_pointer_modifier_button2;
-        break;
+        *modifier = wpe_input_pointer_modifier_button2;
+        return 2;
+    case Qt::MiddleButton:
+        *modifier = wpe_input_pointer_modifier_button3;
+        return 3;
     default:
-        break;
+        *modifier = 0;
+        return 0;
     }
-    m_mousePressedButton = button;
-    uint32_t state = 1;
-    m_mouseModifiers |= modifier;
-    struct wpe_input_pointer_event wpeEvent = { wpe_input_pointer_event_type_button,
-        static_cast<uint32_t>(event->timestamp()),
-        event->x() * m_scale, event->y() * m_scale, button, state, modifiers() };
-    wpe_view_backend_dispatch_pointer_event(backend(), &wpeEvent);
 }
 
-void WPEQtViewBackend::dispatchMouseReleaseEvent(QMouseEvent* event)
+void WPEQtViewBackend::dispatchButton(Qt::MouseButton qtButton, bool pressed, const QPointF& position, uint32_t time)
 {
-    uint32_t button = 0;
+    flushPendingInput();
+
     uint32_t modifier = 0;
-    switch (event->button()) {
-    case Qt::LeftButton:
-        button = 1;
-        modifier = wpe_input_pointer_modifier_button1;
-        break;
-    case Qt::RightButton:
-        button = 2;
-        modifier = wpe_input_pointer_modifier_button2;
-        break;
-    default:
-        break;
+    uint32_t button = wpeButton(qtButton, &modifier);
+    if (pressed) {
+        m_mousePressedButton = button;
+        m_mouseModifiers |= modifier;
+    } else {
+        m_mousePressedButton = 0;
+        m_mouseModifiers &= ~modifier;
     }
-    m_mousePressedButton = 0;
-    uint32_t state = 0;
-    m_mouseModifiers &= ~modifier;
-    struct wpe_input_pointer_event wpeEvent = { wpe_input_pointer_event_type_button,
-        static_cast<uint32_t>(event->timestamp()),
-        event->x() * m_scale, event->y() * m_scale, button, state, modifiers() };
-    wpe_view_backend_dispatch_pointer_event(backend(), &wpeEvent);
+
+    struct wpe_input_pointer_event wpeEvent = { wpe_input_pointer_event_type_button, time,
+        int(position.x() * m_scale), int(position.y() * m_scale), button, pressed, modifiers() };
+    dispatchPointerEvent(wpeEvent);
+}
+
+void WPEQtViewBackend::dispatchMousePressEvent(QMouseEvent* event)
+{
+    dispatchButton(event->button(), true, event->pos(), static_cast<uint32_t>(event->timestamp()));
+}
+
+void WPEQtViewBackend::dispatchMouseReleaseEvent(QMouseEvent* event)
+{
+    dispatchButton(event->button(), false, event->pos(), static_cast<uint32_t>(event->timestamp()));
 }
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
@@ -335,98 +394,372 @@ void WPEQtViewBackend::dispatchMouseReleaseEvent(QMouseEvent* event)
 
 void WPEQtViewBackend::dispatchWheelEvent(QWheelEvent* event)
 {
-    QPoint delta = event->angleDelta();
-    QPoint numDegrees = delta / 8;
-    struct wpe_input_axis_2d_event wpeEvent;
-    if (delta.y() == event->QWHEEL_POSITION.y())
-        wpeEvent.x_axis = numDegrees.x();
+    if (m_hasPendingMotion || m_movedTouchPoints)
+        flushPendingInput();
+
+    uint32_t time = static_cast<uint32_t>(event->timestamp());
+    int32_t x = static_cast<int32_t>(event->QWHEEL_POSITION.x() * m_scale);
+    int32_t y = static_cast<int32_t>(event->QWHEEL_POSITION.y() * m_scale);
+    uint32_t axisModifiers = wpeKeyboardModifiers(event->modifiers()) | m_mouseModifiers;
+
+    // WebKit derives the scroll phases from the deltas: the first non-zero
+    // event begins a scroll and a zero event ends it. Momentum updates are
+    // forwarded like regular ones and terminated by the following ScrollEnd.
+    if (event->phase() == Qt::ScrollEnd) {
+        flushPendingInput();
+        struct wpe_input_axis_2d_event wpeEvent = { { static_cast<wpe_input_axis_event_type>(wpe_input_axis_event_type_mask_2d | wpe_input_axis_event_type_motion_smooth),
+            time, x, y, 0, 0, axisModifiers }, 0, 0 };
+        dispatchAxisEvent(wpeEvent);
+        return;
+    }
+
+    // Touchpads report precise pixel deltas, wheel mice only angle steps.
+    QPointF delta;
+    if (!event->pixelDelta().isNull())
+        delta = QPointF(event->pixelDelta()) * m_scale;
     else
-        wpeEvent.y_axis = numDegrees.y();
-    wpeEvent.base.type = static_cast<wpe_input_axis_event_type>(wpe_input_axis_event_type_mask_2d | wpe_input_axis_event_type_motion_smooth);
-    wpeEvent.base.x = event->QWHEEL_POSITION.x();
-    wpeEvent.base.y = event->QWHEEL_POSITION.y();
-    wpe_view_backend_dispatch_axis_event(backend(), &wpeEvent.base);
+        delta = QPointF(event->angleDelta()) / 8;
+
+    if (delta.isNull())
+        return;
+
+    m_inputStatistics.axisEvents++;
+    if (m_hasPendingAxis && m_pendingAxis.base.modifiers != axisModifiers)
+        flushPendingInput();
+
+    if (m_hasPendingAxis) {
+        m_inputStatistics.coalescedAxisEvents++;
+        m_pendingAxis.x_axis += delta.x();
+        m_pendingAxis.y_axis += delta.y();
+    } else {
+        notePendingInput();
+        m_pendingAxis.base.type = static_cast<wpe_input_axis_event_type>(wpe_input_axis_event_type_mask_2d | wpe_input_axis_event_type_motion_smooth);
+        m_pendingAxis.base.axis = 0;
+        m_pendingAxis.base.value = 0;
+        m_pendingAxis.base.modifiers = axisModifiers;
+        m_pendingAxis.x_axis = delta.x();
+        m_pendingAxis.y_axis = delta.y();
+        m_hasPendingAxis = true;
+    }
+    m_pendingAxis.base.time = time;
+    m_pendingAxis.base.x = x;
+    m_pendingAxis.base.y = y;
 }
 
 static uint32_t qt_key_to_xkb_sym(int key)
 {
-    // This will probably only be used for IME input.
-    // Most of the keys sets text string that can be
-    // forwarded with committed signal.
-    //
-    // Keys that needs to be sent as real key event
-    // are handled here.
+    // Keys that produce text are forwarded through the input method
+    // context, only keys without a character keysym are mapped here.
+    if (key >= Qt::Key_F1 && key <= Qt::Key_F35)
+        return 0xffbe + (key - Qt::Key_F1);
+    if (key >= Qt::Key_Dead_Grave && key <= Qt::Key_Dead_Horn)
+        return 0xfe50 + (key - Qt::Key_Dead_Grave);
 
     switch (key) {
+    case Qt::Key_Escape: return 0xff1b;
+    case Qt::Key_Tab: return 0xff09;
+    case Qt::Key_Backtab: return 0xfe20;
     case Qt::Key_Backspace: return 0xff08;
+    case Qt::Key_Return: return 0xff0d;
+    case Qt::Key_Enter: return 0xff8d;
+    case Qt::Key_Insert: return 0xff63;
+    case Qt::Key_Delete: return 0xffff;
+    case Qt::Key_Pause: return 0xff13;
+    case Qt::Key_Print: return 0xff61;
+    case Qt::Key_SysReq: return 0xff15;
+    case Qt::Key_Clear: return 0xff0b;
+    case Qt::Key_Home: return 0xff50;
+    case Qt::Key_End: return 0xff57;
+    case Qt::Key_Left: return 0xff51;
+    case Qt::Key_Up: return 0xff52;
+    case Qt::Key_Right: return 0xff53;
+    case Qt::Key_Down: return 0xff54;
+    case Qt::Key_PageUp: return 0xff55;
+    case Qt::Key_PageDown: return 0xff56;
+    case Qt::Key_Shift: return 0xffe1;
+    case Qt::Key_Control: return 0xffe3;
+    case Qt::Key_Meta: return 0xffe7;
+    case Qt::Key_Alt: return 0xffe9;
+    case Qt::Key_AltGr: return 0xfe03;
+    case Qt::Key_CapsLock: return 0xffe5;
+    case Qt::Key_NumLock: return 0xff7f;
+    case Qt::Key_ScrollLock: return 0xff14;
+    case Qt::Key_Super_L: return 0xffeb;
+    case Qt::Key_Super_R: return 0xffec;
+    case Qt::Key_Menu: return 0xff67;
+    case Qt::Key_Hyper_L: return 0xffed;
+    case Qt::Key_Hyper_R: return 0xffee;
+    case Qt::Key_Help: return 0xff6a;
+    case Qt::Key_Select: return 0xff60;
+    case Qt::Key_Execute: return 0xff62;
+    case Qt::Key_Undo: return 0xff65;
+    case Qt::Key_Redo: return 0xff66;
+    case Qt::Key_Find: return 0xff68;
+    case Qt::Key_Cancel: return 0xff69;
+    case Qt::Key_Mode_switch: return 0xff7e;
+    case Qt::Key_Multi_key: return 0xff20;
+    case Qt::Key_Codeinput: return 0xff37;
+    case Qt::Key_SingleCandidate: return 0xff3c;
+    case Qt::Key_MultipleCandidate: return 0xff3d;
+    case Qt::Key_PreviousCandidate: return 0xff3e;
+    case Qt::Key_Kanji: return 0xff21;
+    case Qt::Key_Muhenkan: return 0xff22;
+    case Qt::Key_Henkan: return 0xff23;
+    case Qt::Key_Romaji: return 0xff24;
+    case Qt::Key_Hiragana: return 0xff25;
+    case Qt::Key_Katakana: return 0xff26;
+    case Qt::Key_Hiragana_Katakana: return 0xff27;
+    case Qt::Key_Zenkaku: return 0xff28;
+    case Qt::Key_Hankaku: return 0xff29;
+    case Qt::Key_Zenkaku_Hankaku: return 0xff2a;
+    case Qt::Key_Touroku: return 0xff2b;
+    case Qt::Key_Massyo: return 0xff2c;
+    case Qt::Key_Kana_Lock: return 0xff2d;
+    case Qt::Key_Kana_Shift: return 0xff2e;
+    case Qt::Key_Eisu_Shift: return 0xff2f;
+    case Qt::Key_Eisu_toggle: return 0xff30;
+    case Qt::Key_Hangul: return 0xff31;
+    case Qt::Key_Hangul_Start: return 0xff32;
+    case Qt::Key_Hangul_End: return 0xff33;
+    case Qt::Key_Hangul_Hanja: return 0xff34;
+    case Qt::Key_Hangul_Jamo: return 0xff35;
+    case Qt::Key_Hangul_Romaja: return 0xff36;
+    case Qt::Key_Hangul_Jeonja: return 0xff38;
+    case Qt::Key_Hangul_Banja: return 0xff39;
+    case Qt::Key_Hangul_PreHanja: return 0xff3a;
+    case Qt::Key_Hangul_PostHanja: return 0xff3b;
+    case Qt::Key_Hangul_Special: return 0xff3f;
+    case Qt::Key_MonBrightnessUp: return 0x1008ff02;
+    case Qt::Key_MonBrightnessDown: return 0x1008ff03;
+    case Qt::Key_Standby: return 0x1008ff10;
+    case Qt::Key_VolumeDown: return 0x1008ff11;
+    case Qt::Key_VolumeMute: return 0x1008ff12;
+    case Qt::Key_VolumeUp: return 0x1008ff13;
+    case Qt::Key_MediaPlay: return 0x1008ff14;
+    case Qt::Key_MediaStop: return 0x1008ff15;
+    case Qt::Key_MediaPrevious: return 0x1008ff16;
+    case Qt::Key_MediaNext: return 0x1008ff17;
+    case Qt::Key_HomePage: return 0x1008ff18;
+    case Qt::Key_LaunchMail: return 0x1008ff19;
+    case Qt::Key_Search: return 0x1008ff1b;
+    case Qt::Key_MediaRecord: return 0x1008ff1c;
+    case Qt::Key_Calculator: return 0x1008ff1d;
+    case Qt::Key_Back: return 0x1008ff26;
+    case Qt::Key_Forward: return 0x1008ff27;
+    case Qt::Key_Stop: return 0x1008ff28;
+    case Qt::Key_Refresh: return 0x1008ff29;
+    case Qt::Key_PowerOff: return 0x1008ff2a;
+    case Qt::Key_WakeUp: return 0x1008ff2b;
+    case Qt::Key_Eject: return 0x1008ff2c;
+    case Qt::Key_Sleep: return 0x1008ff2f;
+    case Qt::Key_Favorites: return 0x1008ff30;
+    case Qt::Key_MediaPause: return 0x1008ff31;
+    case Qt::Key_OpenUrl: return 0x1008ff38;
+    case Qt::Key_Close: return 0x1008ff56;
+    case Qt::Key_Copy: return 0x1008ff57;
+    case Qt::Key_Cut: return 0x1008ff58;
+    case Qt::Key_Paste: return 0x1008ff6d;
+    case Qt::Key_Reload: return 0x1008ff73;
+    case Qt::Key_ZoomIn: return 0x1008ff8b;
+    case Qt::Key_ZoomOut: return 0x1008ff8c;
     default: return 0;
     }
 }
 
+static uint32_t keysymForCharacter(uint ucs4)
+{
+    // Latin-1 characters are their own keysym, everything else uses
+    // the Unicode keysym range.
+    if ((ucs4 >= 0x20 && ucs4 < 0x7f) || (ucs4 >= 0xa0 && ucs4 <= 0xff))
+        return ucs4;
+    return 0x01000000 | ucs4;
+}
+
+void WPEQtViewBackend::dispatchKey(uint32_t keysym, uint32_t keycode, bool pressed, uint32_t modifiers, uint32_t time)
+{
+    flushPendingInput();
+
+    struct wpe_input_keyboard_event wpeEvent = { time, keysym, keycode, pressed, modifiers };
+    WPEQtWebKitThread::invoke([viewBackend = backend(), wpeEvent]() mutable {
+        wpe_view_backend_dispatch_keyboard_event(viewBackend, &wpeEvent);
+    });
+}
+
+void WPEQtViewBackend::injectInputEvent(const QVariantMap& event)
+{
+    const QString type = event.value(QStringLiteral("type")).toString();
+    uint32_t time = event.contains(QStringLiteral("time")) ? event.value(QStringLiteral("time")).toUInt() : static_cast<uint32_t>(g_get_monotonic_time() / 1000);
+    uint32_t keyboardModifiers = wpeKeyboardModifiers(Qt::KeyboardModifiers(event.value(QStringLiteral("modifiers")).toInt()));
+    QPointF position(event.value(QStringLiteral("x")).toReal(), event.value(QStringLiteral("y")).toReal());
+    int32_t x = static_cast<int32_t>(position.x() * m_scale);
+    int32_t y = static_cast<int32_t>(position.y() * m_scale);
+
+    if (type == QLatin1String("keyPress") || type == QLatin1String("keyRelease")) {
+        int key = event.value(QStringLiteral("key")).toInt();
+        uint32_t keysym = qt_key_to_xkb_sym(key);
+        if (!keysym) {
+            const QString text = event.value(QStringLiteral("text")).toString();
+            if (!text.isEmpty())
+                keysym = keysymForCharacter(text.toUcs4().constFirst());
+            else if (key >= Qt::Key_Space && key <= Qt::Key_ydiaeresis)
+                keysym = keysymForCharacter(QChar(key).toLower().unicode());
+        }
+        dispatchKey(keysym, 0, type == QLatin1String("keyPress"), keyboardModifiers, time);
+    } else if (type == QLatin1String("mouseMove")) {
+        flushPendingInput();
+        struct wpe_input_pointer_event wpeEvent = { wpe_input_pointer_event_type_motion, time, x, y,
+            m_mousePressedButton, !!m_mousePressedButton, modifiers() | keyboardModifiers };
+        dispatchPointerEvent(wpeEvent);
+    } else if (type == QLatin1String("mousePress") || type == QLatin1String("mouseRelease")) {
+        auto button = static_cast<Qt::MouseButton>(event.value(QStringLiteral("button"), int(Qt::LeftButton)).toInt());
+        dispatchButton(button, type == QLatin1String("mousePress"), position, time);
+    } else if (type == QLatin1String("wheel")) {
+        flushPendingInput();
+        struct wpe_input_axis_2d_event wpeEvent = { { static_cast<wpe_input_axis_event_type>(wpe_input_axis_event_type_mask_2d | wpe_input_axis_event_type_motion_smooth),
+            time, x, y, 0, 0, keyboardModifiers | m_mouseModifiers },
+            event.value(QStringLiteral("dx")).toReal() * m_scale, event.value(QStringLiteral("dy")).toReal() * m_scale };
+        dispatchAxisEvent(wpeEvent);
+    } else if (type == QLatin1String("touchPress") || type == QLatin1String("touchMove") || type == QLatin1String("touchRelease")) {
+        wpe_input_touch_event_type touchType = wpe_input_touch_event_type_motion;
+        if (type == QLatin1String("touchPress"))
+            touchType = wpe_input_touch_event_type_down;
+        else if (type == QLatin1String("touchRelease"))
+            touchType = wpe_input_touch_event_type_up;
+        updateTouchPoint(touchType, event.value(QStringLiteral("id")).toInt(), x, y, time);
+        flushPendingInput();
+    } else
+        qWarning("Unknown input event type: %s", qPrintable(type));
+}
+
 void WPEQtViewBackend::dispatchKeyEvent(QKeyEvent* event, bool state)
 {
+    uint32_t keysym = event->nativeVirtualKey();
+    if (!keysym)
+        keysym = qt_key_to_xkb_sym(event->key());
+
     // IME input
-    if (!event->nativeVirtualKey() && !event->nativeScanCode()) {
+    if (!keysym && !event->nativeScanCode()) {
         if (!event->text().isEmpty()) {
-            if (event->type() == QEvent::KeyPress)
+            flushPendingInput();
+            // There is no input method context with a WebKit thread.
+            if (event->type() == QEvent::KeyPress && m_view && m_view->m_imContext)
                 g_signal_emit_by_name(m_view->m_imContext, "committed", qPrintable(event->text()));
             return;
         }
     }
 
-    uint32_t keysym = event->nativeVirtualKey();
-    if (!keysym)
-        keysym = qt_key_to_xkb_sym(event->key());
-
-    uint32_t modifiers = 0;
     Qt::KeyboardModifiers qtModifiers = event->modifiers();
     if (!qtModifiers)
         qtModifiers = QGuiApplication::keyboardModifiers();
 
-    if (qtModifiers & Qt::ShiftModifier)
-        modifiers |= wpe_input_keyboard_modifier_shift;
+    dispatchKey(keysym, event->nativeScanCode(), state, wpeKeyboardModifiers(qtModifiers), static_cast<uint32_t>(event->timestamp()));
+}
 
-    if (qtModifiers & Qt::ControlModifier)
-        modifiers |= wpe_input_keyboard_modifier_control;
-    if (qtModifiers & Qt::MetaModifier)
-        modifiers |= wpe_input_keyboard_modifier_meta;
-    if (qtModifiers & Qt::AltModifier)
-        modifiers |= wpe_input_keyboard_modifier_alt;
+struct wpe_input_touch_event_raw* WPEQtViewBackend::touchPoint(int id, bool allocate)
+{
+    struct wpe_input_touch_event_raw* freeSlot = nullptr;
+    for (auto& point : m_touchPoints) {
+        if (point.type == wpe_input_touch_event_type_null) {
+            if (!freeSlot)
+                freeSlot = &point;
+        } else if (point.id == id)
+            return &point;
+    }
+    return allocate ? freeSlot : nullptr;
+}
 
-    struct wpe_input_keyboard_event wpeEvent = { static_cast<uint32_t>(event->timestamp()),
-        keysym, event->nativeScanCode(), state, modifiers };
-    wpe_view_backend_dispatch_keyboard_event(backend(), &wpeEvent);
+void WPEQtViewBackend::dispatchTouchPoints(wpe_input_touch_event_type type, int32_t id, uint32_t time)
+{
+    // WebKit skips the null entries, so the whole table is sent as is.
+    WPEQtWebKitThread::invoke([viewBackend = backend(), touchPoints = m_touchPoints, type, id, time, eventModifiers = modifiers()]() mutable {
+        struct wpe_input_touch_event wpeEvent = { touchPoints.data(), touchPoints.size(), type, id, time, eventModifiers };
+        wpe_view_backend_dispatch_touch_event(viewBackend, &wpeEvent);
+    });
 }
 
-void WPEQtViewBackend::dispatchTouchEvent(QTouchEvent* event)
+void WPEQtViewBackend::dispatchPointerEvent(const struct wpe_input_pointer_event& event)
+{
+    WPEQtWebKitThread::invoke([viewBackend = backend(), event]() mutable {
+        wpe_view_backend_dispatch_pointer_event(viewBackend, &event);
+    });
+}
+
+void WPEQtViewBackend::dispatchAxisEvent(const struct wpe_input_axis_2d_event& event)
 {
-    wpe_input_touch_event_type eventType;
-    switch (event->type()) {
-    case QEvent::TouchBegin:
-        eventType = wpe_input_touch_event_type_down;
+    WPEQtWebKitThread::invoke([viewBackend = backend(), event]() mutable {
+        wpe_view_backend_dispatch_axis_event(viewBackend, &event.base);
+    });
+}
+
+void WPEQtViewBackend::updateTouchPoint(wpe_input_touch_event_type type, int32_t id, int32_t x, int32_t y, uint32_t time)
+{
+    auto* rawPoint = touchPoint(id, type == wpe_input_touch_event_type_down);
+    if (!rawPoint)
+        return;
+
+    switch (type) {
+    case wpe_input_touch_event_type_down:
+        flushPendingInput();
+        *rawPoint = { wpe_input_touch_event_type_down, time, id, x, y };
+        dispatchTouchPoints(wpe_input_touch_event_type_down, id, time);
+        rawPoint->type = wpe_input_touch_event_type_motion;
         break;
-    case QEvent::TouchUpdate:
-        eventType = wpe_input_touch_event_type_motion;
+    case wpe_input_touch_event_type_up:
+        flushPendingInput();
+        *rawPoint = { wpe_input_touch_event_type_up, time, id, x, y };
+        dispatchTouchPoints(wpe_input_touch_event_type_up, id, time);
+        rawPoint->type = wpe_input_touch_event_type_null;
         break;
-    case QEvent::TouchEnd:
-        eventType = wpe_input_touch_event_type_up;
+    case wpe_input_touch_event_type_motion: {
+        const uint32_t bit = 1u << (rawPoint - m_touchPoints.data());
+        m_inputStatistics.motionEvents++;
+        if (m_movedTouchPoints & bit)
+            m_inputStatistics.coalescedMotionEvents++;
+        notePendingInput();
+        rawPoint->time = time;
+        rawPoint->x = x;
+        rawPoint->y = y;
+        m_movedTouchPoints |= bit;
         break;
+    }
     default:
-        eventType = wpe_input_touch_event_type_null;
         break;
     }
+}
 
-    int i = 0;
-    struct wpe_input_touch_event_raw* rawEvents = g_new0(wpe_input_touch_event_raw, event->touchPoints().length());
-    for (auto& point : event->touchPoints()) {
-        rawEvents[i] = { eventType, static_cast<uint32_t>(event->timestamp()),
-            point.id(), static_cast<int32_t>(point.pos().x()), static_cast<int32_t>(point.pos().y()) };
-        i++;
+void WPEQtViewBackend::dispatchTouchEvent(QTouchEvent* event)
+{
+    uint32_t time = static_cast<uint32_t>(event->timestamp());
+
+    if (event->type() == QEvent::TouchCancel) {
+        flushPendingInput();
+        for (auto& point : m_touchPoints) {
+            if (point.type == wpe_input_touch_event_type_null)
+                continue;
+            point.type = wpe_input_touch_event_type_up;
+            point.time = time;
+            dispatchTouchPoints(wpe_input_touch_event_type_up, point.id, time);
+            point.type = wpe_input_touch_event_type_null;
+        }
+        return;
     }
 
-    struct wpe_input_touch_event wpeEvent = { rawEvents, static_cast<uint64_t>(i), eventType,
-        static_cast<int32_t>(rawEvents[0].id),
-        static_cast<uint32_t>(event->timestamp()), modifiers() };
-    wpe_view_backend_dispatch_touch_event(backend(), &wpeEvent);
-    g_free(rawEvents);
+    for (const auto& point : event->touchPoints()) {
+        int32_t x = static_cast<int32_t>(point.pos().x() * m_scale);
+        int32_t y = static_cast<int32_t>(point.pos().y() * m_scale);
+
+        switch (point.state()) {
+        case Qt::TouchPointPressed:
+            updateTouchPoint(wpe_input_touch_event_type_down, point.id(), x, y, time);
+            break;
+        case Qt::TouchPointReleased:
+            updateTouchPoint(wpe_input_touch_event_type_up, point.id(), x, y, time);
+            break;
+        case Qt::TouchPointMoved:
+            updateTouchPoint(wpe_input_touch_event_type_motion, point.id(), x, y, time);
+            break;
+        default:
+            break;
+        }
+    }
 }
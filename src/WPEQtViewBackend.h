@@ -24,13 +24,18 @@
 #include <gbm.h>
 #include <epoxy/egl.h>
 
+#include <QElapsedTimer>
 #include <QHoverEvent>
 #include <QKeyEvent>
 #include <QMouseEvent>
-#include <QOffscreenSurface>
+#include <QMutex>
 #include <QOpenGLContext>
 #include <QPointer>
+#include <QSize>
+#include <QVariantMap>
 #include <QWheelEvent>
+#include <array>
+#include <memory>
 #include <wpe/fdo-egl.h>
 #include <wpe/fdo.h>
 
@@ -38,15 +43,37 @@ class WPEQtView;
 
 class Q_DECL_EXPORT WPEQtViewBackend {
 public:
+    struct InputStatistics {
+        quint64 motionEvents { 0 };
+        quint64 coalescedMotionEvents { 0 };
+        quint64 axisEvents { 0 };
+        quint64 coalescedAxisEvents { 0 };
+        quint64 flushes { 0 };
+        qint64 totalFlushLatency { 0 };
+        qint64 maxFlushLatency { 0 };
+    };
+
+    struct FrameStatistics {
+        quint64 frames { 0 };
+        quint64 fencedFrames { 0 };
+        quint64 stalls { 0 };
+        qint64 totalStallTime { 0 };
+        qint64 maxStallTime { 0 };
+    };
+
     static std::unique_ptr<WPEQtViewBackend> create(const QSizeF&, QPointer<QOpenGLContext>, EGLDisplay, QPointer<WPEQtView>);
-    WPEQtViewBackend(const QSizeF&, EGLDisplay, EGLContext, QPointer<QOpenGLContext>, QPointer<WPEQtView>);
+    WPEQtViewBackend(const QSizeF&, EGLDisplay, QPointer<WPEQtView>);
     virtual ~WPEQtViewBackend();
 
     void setScaleFactor(float factor);
 
     void resize(const QSizeF&);
     GLuint texture(QOpenGLContext*);
-    bool hasValidSurface() const { return m_surface.isValid(); };
+    // Size in pixels of the last frame, scaled by the device scale factor.
+    QSize textureSize() const { return m_textureSize; }
+    // EGL_NONE when frames are handed back to WebKit without a fence.
+    EGLenum fenceType() const { return m_fenceType; }
+    FrameStatistics frameStatistics() const;
 
     void dispatchHoverEnterEvent(QHoverEvent*);
     void dispatchHoverLeaveEvent(QHoverEvent*);
@@ -61,28 +88,63 @@ public:
 
     void dispatchTouchEvent(QTouchEvent*);
 
+    void injectInputEvent(const QVariantMap&);
+
+    void flushPendingInput();
+    const InputStatistics& inputStatistics() const { return m_inputStatistics; }
+
     struct wpe_view_backend* backend() const { return wpe_view_backend_exportable_fdo_get_view_backend(m_exportable); };
 
 private:
+    struct Frame {
+        struct wpe_fdo_egl_exported_image* image { nullptr };
+        EGLSyncKHR fence { EGL_NO_SYNC_KHR };
+    };
+
     void displayImage(struct wpe_fdo_egl_exported_image*);
+    void releaseRetiredFrame();
     uint32_t modifiers() const;
+    bool hasPendingInput() const { return m_hasPendingMotion || m_movedTouchPoints || m_hasPendingAxis; }
+    void notePendingInput();
+    void queuePointerMotion(const struct wpe_input_pointer_event&);
+    void dispatchButton(Qt::MouseButton, bool pressed, const QPointF& position, uint32_t time);
+    void dispatchKey(uint32_t keysym, uint32_t keycode, bool pressed, uint32_t modifiers, uint32_t time);
+    void updateTouchPoint(wpe_input_touch_event_type, int32_t id, int32_t x, int32_t y, uint32_t time);
+    struct wpe_input_touch_event_raw* touchPoint(int id, bool allocate);
+    void dispatchTouchPoints(wpe_input_touch_event_type, int32_t id, uint32_t time);
+    void dispatchPointerEvent(const struct wpe_input_pointer_event&);
+    void dispatchAxisEvent(const struct wpe_input_axis_2d_event&);
 
     EGLDisplay m_eglDisplay { nullptr };
-    EGLContext m_eglContext { nullptr };
     struct wpe_view_backend_exportable_fdo* m_exportable { nullptr };
     struct wpe_fdo_egl_exported_image* m_lockedImage { nullptr };
-    struct wpe_fdo_egl_exported_image* m_lockedImageOld { nullptr };
+    // Images are exported on the WebKit thread and drawn on the render thread.
+    mutable QMutex m_imageLock;
+    // Only used on the render thread. The retired frame goes back to WebKit
+    // once the GPU is done with it, as told by its fence.
+    Frame m_displayedFrame;
+    Frame m_retiredFrame;
+    EGLenum m_fenceType { EGL_NONE };
+    FrameStatistics m_frameStatistics;
 
     QPointer<WPEQtView> m_view;
-    QOffscreenSurface m_surface;
     QSizeF m_size;
     GLuint m_textureId { 0 };
-    unsigned m_program { 0 };
-    unsigned m_textureUniform { 0 };
+    QSize m_textureSize;
     float m_scale = 1.0;
 
     bool m_hovering { false };
     uint32_t m_mouseModifiers { 0 };
     uint32_t m_keyboardModifiers { 0 };
     uint32_t m_mousePressedButton { 0 };
+
+    bool m_hasPendingMotion { false };
+    struct wpe_input_pointer_event m_pendingMotion;
+    // One bit per entry of m_touchPoints that moved since the last flush.
+    uint32_t m_movedTouchPoints { 0 };
+    std::array<struct wpe_input_touch_event_raw, 10> m_touchPoints { };
+    bool m_hasPendingAxis { false };
+    struct wpe_input_axis_2d_event m_pendingAxis;
+    QElapsedTimer m_pendingInputTimer;
+    InputStatistics m_inputStatistics;
 };
@@ -21,9 +21,6 @@
 #include "config.h"
 #include "WPEQtViewLoadRequest.h"
 
-#include "WPEQtView.h"
-#include "WPEQtViewLoadRequestPrivate.h"
-
 /*!
   \qmltype WPEViewLoadRequest
   \instantiates WPEQtViewLoadRequest
@@ -32,19 +29,11 @@
   \brief A utility type for \l {WPEView}'s \l {WPEView::}{loadingChanged()} signal.
 
   The WPEViewLoadRequest type contains load status information for the requested URL.
+  It is a value type: handlers receive a copy which stays valid after the
+  signal handler returns and can be stored freely.
 
   \sa {WPEView::loadingChanged()}{WPEView.loadingChanged()}
 */
-WPEQtViewLoadRequest::WPEQtViewLoadRequest(const WPEQtViewLoadRequestPrivate& d)
-    : d_ptr(new WPEQtViewLoadRequestPrivate(d))
-{
-
-}
-
-WPEQtViewLoadRequest::~WPEQtViewLoadRequest()
-{
-
-}
 
 /*!
   \qmlproperty url WPEView::WPEViewLoadRequest::url
@@ -52,11 +41,6 @@ WPEQtViewLoadRequest::~WPEQtViewLoadRequest()
 
   The URL of the load request.
 */
-QUrl WPEQtViewLoadRequest::url() const
-{
-    Q_D(const WPEQtViewLoadRequest);
-    return d->m_url;
-}
 
 /*!
   \qmlproperty enumeration WPEViewLoadRequest::status
@@ -68,14 +52,13 @@ QUrl WPEQtViewLoadRequest::url() const
   \value WPEView.LoadStoppedStatus The page loading was interrupted.
   \value WPEView.LoadSucceededStatus The page was loaded successfully.
   \value WPEView.LoadFailedStatus The page could not be loaded.
+  \value WPEView.LoadCommittedStatus The first data of the page was received
+         and the previous page was replaced.
+  \value WPEView.LoadRedirectedStatus The request was redirected, \e url
+         holds the new location.
 
   \sa {WPEView::loadingChanged()}{WPEView.loadingChanged}
 */
-WPEQtView::LoadStatus WPEQtViewLoadRequest::status() const
-{
-    Q_D(const WPEQtViewLoadRequest);
-    return d->m_status;
-}
 
 /*!
   \qmlproperty string WPEView::WPEViewLoadRequest::errorString
@@ -83,8 +66,18 @@ WPEQtView::LoadStatus WPEQtViewLoadRequest::status() const
 
   Holds the error message if the load request failed.
 */
-QString WPEQtViewLoadRequest::errorString() const
-{
-    Q_D(const WPEQtViewLoadRequest);
-    return d->m_errorString;
-}
+
+/*!
+  \qmlproperty int WPEView::WPEViewLoadRequest::startTime
+  \readonly
+
+  The time the load started, in milliseconds since the epoch.
+*/
+
+/*!
+  \qmlproperty int WPEView::WPEViewLoadRequest::elapsedTime
+  \readonly
+
+  The time elapsed between the start of the load and this status change,
+  in milliseconds.
+*/
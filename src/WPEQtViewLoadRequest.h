@@ -22,29 +22,40 @@
 
 #include "WPEQtView.h"
 
-#include <QObject>
-
-class WPEQtViewLoadRequestPrivate;
-
-class WPEQtViewLoadRequest : public QObject {
-    Q_OBJECT
-    Q_PROPERTY(QUrl url READ url)
-    Q_PROPERTY(WPEQtView::LoadStatus status READ status)
-    Q_PROPERTY(QString errorString READ errorString)
+#include <QMetaType>
+#include <QString>
+#include <QUrl>
+
+class WPEQtViewLoadRequest {
+    Q_GADGET
+    Q_PROPERTY(QUrl url READ url CONSTANT)
+    Q_PROPERTY(WPEQtView::LoadStatus status READ status CONSTANT)
+    Q_PROPERTY(QString errorString READ errorString CONSTANT)
+    Q_PROPERTY(qint64 startTime READ startTime CONSTANT)
+    Q_PROPERTY(qint64 elapsedTime READ elapsedTime CONSTANT)
 
 public:
-    ~WPEQtViewLoadRequest();
-
-    QUrl url() const;
-    WPEQtView::LoadStatus status() const;
-    QString errorString() const;
-
-    explicit WPEQtViewLoadRequest(const WPEQtViewLoadRequestPrivate&);
+    WPEQtViewLoadRequest() = default;
+    WPEQtViewLoadRequest(const QUrl& url, WPEQtView::LoadStatus status, const QString& errorString = QString(), qint64 startTime = 0, qint64 elapsedTime = 0)
+        : m_url(url)
+        , m_status(status)
+        , m_errorString(errorString)
+        , m_startTime(startTime)
+        , m_elapsedTime(elapsedTime)
+    { }
+
+    QUrl url() const { return m_url; }
+    WPEQtView::LoadStatus status() const { return m_status; }
+    QString errorString() const { return m_errorString; }
+    qint64 startTime() const { return m_startTime; }
+    qint64 elapsedTime() const { return m_elapsedTime; }
 
 private:
-    friend class WPEQtView;
-
-    Q_DECLARE_PRIVATE(WPEQtViewLoadRequest)
-    QScopedPointer<WPEQtViewLoadRequestPrivate> d_ptr;
+    QUrl m_url;
+    WPEQtView::LoadStatus m_status { WPEQtView::LoadStartedStatus };
+    QString m_errorString;
+    qint64 m_startTime { 0 };
+    qint64 m_elapsedTime { 0 };
 };
 
+Q_DECLARE_METATYPE(WPEQtViewLoadRequest)
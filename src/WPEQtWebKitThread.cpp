@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtWebKitThread.h"
+
+#include <QCoreApplication>
+#include <QMetaObject>
+
+WPEQtWebKitThread::TaskQueue::TaskQueue()
+    : m_head(&m_stub)
+    , m_tail(&m_stub)
+{
+}
+
+void WPEQtWebKitThread::TaskQueue::push(Task* task)
+{
+    task->next.store(nullptr, std::memory_order_relaxed);
+    Task* previous = m_head.exchange(task, std::memory_order_acq_rel);
+    previous->next.store(task, std::memory_order_release);
+}
+
+WPEQtWebKitThread::Task* WPEQtWebKitThread::TaskQueue::pop()
+{
+    Task* tail = m_tail;
+    Task* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &m_stub) {
+        if (!next)
+            return nullptr;
+        m_tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        m_tail = next;
+        return tail;
+    }
+
+    // A producer is between its two steps, the task becomes visible once
+    // it is done and it schedules a dispatch afterwards.
+    if (tail != m_head.load(std::memory_order_acquire))
+        return nullptr;
+
+    push(&m_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        m_tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+void WPEQtWebKitThread::Latency::add(qint64 latency)
+{
+    count.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(latency, std::memory_order_relaxed);
+    // Only one thread records each latency, no need for a CAS loop.
+    if (latency > max.load(std::memory_order_relaxed))
+        max.store(latency, std::memory_order_relaxed);
+}
+
+WPEQtWebKitThread* WPEQtWebKitThread::instance()
+{
+    // Lives as long as the process, like WebKit's own main thread.
+    static WPEQtWebKitThread* thread = qEnvironmentVariableIntValue("WPEQT_WEBKIT_THREAD") ? new WPEQtWebKitThread : nullptr;
+    return thread;
+}
+
+WPEQtWebKitThread::WPEQtWebKitThread()
+    : m_context(g_main_context_new())
+{
+    static GSourceFuncs sourceFuncs = {
+        nullptr, // prepare
+        nullptr, // check
+        // dispatch
+        [](GSource* source, GSourceFunc, gpointer userData) -> gboolean
+        {
+            g_source_set_ready_time(source, -1);
+            static_cast<WPEQtWebKitThread*>(userData)->dispatchCommands();
+            return G_SOURCE_CONTINUE;
+        },
+        nullptr, // finalize
+        nullptr, // closure_callback
+        nullptr, // closure_marshall
+    };
+
+    m_commandSource = g_source_new(&sourceFuncs, sizeof(GSource));
+    g_source_set_name(m_commandSource, "[WPEQt] WebKit thread commands");
+    g_source_set_priority(m_commandSource, G_PRIORITY_HIGH);
+    g_source_set_callback(m_commandSource, nullptr, this, nullptr);
+    g_source_set_ready_time(m_commandSource, -1);
+    g_source_attach(m_commandSource, m_context);
+
+    // WebKit takes the first thread that uses it as its main thread, and the
+    // thread default context as the context of its main run loop.
+    m_thread = std::thread([this] {
+        g_main_context_push_thread_default(m_context);
+        GMainLoop* loop = g_main_loop_new(m_context, FALSE);
+        g_main_loop_run(loop);
+    });
+}
+
+void WPEQtWebKitThread::post(std::function<void()>&& function)
+{
+    auto* task = new Task;
+    task->function = std::move(function);
+    task->queueTime = g_get_monotonic_time();
+    m_commands.push(task);
+
+    // Only the first command after a dispatch wakes the thread up.
+    if (!m_commandsScheduled.exchange(true, std::memory_order_acq_rel))
+        g_source_set_ready_time(m_commandSource, 0);
+}
+
+void WPEQtWebKitThread::dispatchCommands()
+{
+    // A plain store could be ordered after the pops below, a command pushed
+    // in between would then neither be seen nor wake the thread up.
+    m_commandsScheduled.exchange(false, std::memory_order_acq_rel);
+    while (auto* task = m_commands.pop()) {
+        m_commandLatency.add(g_get_monotonic_time() - task->queueTime);
+        task->function();
+        delete task;
+    }
+}
+
+void WPEQtWebKitThread::postToGui(std::function<void()>&& function)
+{
+    auto* task = new Task;
+    task->function = std::move(function);
+    task->queueTime = g_get_monotonic_time();
+    m_results.push(task);
+
+    // Results queued until the GUI thread gets to them are delivered
+    // together, with a single event.
+    if (!m_resultsScheduled.exchange(true, std::memory_order_acq_rel)) {
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [this] {
+            deliverResults();
+        }, Qt::QueuedConnection);
+    }
+}
+
+void WPEQtWebKitThread::deliverResults()
+{
+    m_resultsScheduled.exchange(false, std::memory_order_acq_rel);
+    m_batches.fetch_add(1, std::memory_order_relaxed);
+    while (auto* task = m_results.pop()) {
+        m_resultLatency.add(g_get_monotonic_time() - task->queueTime);
+        task->function();
+        delete task;
+    }
+}
+
+QVariantMap WPEQtWebKitThread::statistics() const
+{
+    auto latencyStatistics = [](const Latency& latency) {
+        const quint64 count = latency.count.load(std::memory_order_relaxed);
+        QVariantMap statistics;
+        statistics.insert(QStringLiteral("count"), count);
+        statistics.insert(QStringLiteral("averageLatency"), count ? latency.total.load(std::memory_order_relaxed) / qint64(count) : 0);
+        statistics.insert(QStringLiteral("maxLatency"), latency.max.load(std::memory_order_relaxed));
+        return statistics;
+    };
+
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("commands"), latencyStatistics(m_commandLatency));
+    statistics.insert(QStringLiteral("results"), latencyStatistics(m_resultLatency));
+    statistics.insert(QStringLiteral("batches"), m_batches.load(std::memory_order_relaxed));
+    return statistics;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <QPointer>
+#include <QSemaphore>
+#include <QVariantMap>
+#include <atomic>
+#include <functional>
+#include <glib.h>
+#include <thread>
+
+// Runs WebKit on a thread of its own, with its own GMainContext, so that a
+// slow QML frame does not delay WebKit and the other way around. Enabled
+// for the whole process by setting WPEQT_WEBKIT_THREAD=1, WebKit only
+// supports being used from a single thread.
+//
+// Commands reach the WebKit thread through a lock-free queue; results are
+// queued back and delivered to the GUI thread in batches, one event per
+// batch. Without the thread both run immediately on the calling thread.
+class WPEQtWebKitThread {
+public:
+    // The WebKit thread, or nullptr when WebKit runs on the GUI thread.
+    static WPEQtWebKitThread* instance();
+
+    template<typename Function> static void invoke(Function&&);
+    template<typename Function> static void invokeAndWait(Function&&);
+    template<typename Function> static void deliver(Function&&);
+    // Dropped if the receiver is destroyed before delivery.
+    template<typename Function> static void deliver(QObject* receiver, Function&&);
+    // Same, for callers that may run while the receiver is being destroyed:
+    // the guard is copied and only checked on the GUI thread.
+    template<typename T, typename Function> static void deliver(const QPointer<T>& receiver, Function&&);
+
+    bool isCurrent() const { return std::this_thread::get_id() == m_thread.get_id(); }
+    GMainContext* context() const { return m_context; }
+    QVariantMap statistics() const;
+
+private:
+    struct Task {
+        std::atomic<Task*> next { nullptr };
+        std::function<void()> function;
+        gint64 queueTime { 0 };
+    };
+
+    // Intrusive multiple producer, single consumer queue, producers never
+    // wait on each other nor on the consumer.
+    class TaskQueue {
+    public:
+        TaskQueue();
+
+        void push(Task*);
+        Task* pop();
+
+    private:
+        std::atomic<Task*> m_head;
+        Task* m_tail;
+        Task m_stub;
+    };
+
+    struct Latency {
+        std::atomic<quint64> count { 0 };
+        std::atomic<qint64> total { 0 };
+        std::atomic<qint64> max { 0 };
+
+        void add(qint64);
+    };
+
+    WPEQtWebKitThread();
+
+    void post(std::function<void()>&&);
+    void postToGui(std::function<void()>&&);
+    void dispatchCommands();
+    void deliverResults();
+
+    GMainContext* m_context { nullptr };
+    GSource* m_commandSource { nullptr };
+    TaskQueue m_commands;
+    std::atomic<bool> m_commandsScheduled { false };
+    TaskQueue m_results;
+    std::atomic<bool> m_resultsScheduled { false };
+    Latency m_commandLatency;
+    Latency m_resultLatency;
+    std::atomic<quint64> m_batches { 0 };
+    std::thread m_thread;
+};
+
+template<typename Function> void WPEQtWebKitThread::invoke(Function&& function)
+{
+    auto* thread = instance();
+    if (!thread || thread->isCurrent()) {
+        function();
+        return;
+    }
+
+    thread->post(std::forward<Function>(function));
+}
+
+template<typename Function> void WPEQtWebKitThread::invokeAndWait(Function&& function)
+{
+    auto* thread = instance();
+    if (!thread || thread->isCurrent()) {
+        function();
+        return;
+    }
+
+    QSemaphore done;
+    thread->post([&] {
+        function();
+        done.release();
+    });
+    done.acquire();
+}
+
+template<typename Function> void WPEQtWebKitThread::deliver(Function&& function)
+{
+    auto* thread = instance();
+    if (!thread || !thread->isCurrent()) {
+        function();
+        return;
+    }
+
+    thread->postToGui(std::forward<Function>(function));
+}
+
+template<typename Function> void WPEQtWebKitThread::deliver(QObject* receiver, Function&& function)
+{
+    auto* thread = instance();
+    if (!thread || !thread->isCurrent()) {
+        function();
+        return;
+    }
+
+    thread->postToGui([receiver = QPointer<QObject>(receiver), function = std::forward<Function>(function)]() mutable {
+        if (receiver)
+            function();
+    });
+}
+
+template<typename T, typename Function> void WPEQtWebKitThread::deliver(const QPointer<T>& receiver, Function&& function)
+{
+    auto* thread = instance();
+    if (!thread || !thread->isCurrent()) {
+        if (receiver)
+            function();
+        return;
+    }
+
+    thread->postToGui([receiver, function = std::forward<Function>(function)]() mutable {
+        if (receiver)
+            function();
+    });
+}
@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtWebsiteData.h"
+
+#include <QFile>
+#include <QPointer>
+#include <QQmlEngine>
+#include <QVariant>
+#include <memory>
+#include <wtf/glib/GUniquePtr.h>
+
+struct WebsiteDataCallbackData {
+    QJSValue callback;
+    QPointer<WPEQtWebsiteData> object;
+};
+
+static WebKitWebsiteDataTypes webkitDataTypes(int types)
+{
+    unsigned result = 0;
+    if (types & WPEQtWebsiteData::MemoryCache)
+        result |= WEBKIT_WEBSITE_DATA_MEMORY_CACHE;
+    if (types & WPEQtWebsiteData::DiskCache)
+        result |= WEBKIT_WEBSITE_DATA_DISK_CACHE;
+    if (types & WPEQtWebsiteData::OfflineApplicationCache)
+        result |= WEBKIT_WEBSITE_DATA_OFFLINE_APPLICATION_CACHE;
+    if (types & WPEQtWebsiteData::SessionStorage)
+        result |= WEBKIT_WEBSITE_DATA_SESSION_STORAGE;
+    if (types & WPEQtWebsiteData::LocalStorage)
+        result |= WEBKIT_WEBSITE_DATA_LOCAL_STORAGE;
+    if (types & WPEQtWebsiteData::IndexedDBDatabases)
+        result |= WEBKIT_WEBSITE_DATA_INDEXEDDB_DATABASES;
+    if (types & WPEQtWebsiteData::Cookies)
+        result |= WEBKIT_WEBSITE_DATA_COOKIES;
+#if WEBKIT_CHECK_VERSION(2, 30, 0)
+    if (types & WPEQtWebsiteData::ServiceWorkerRegistrations)
+        result |= WEBKIT_WEBSITE_DATA_SERVICE_WORKER_REGISTRATIONS;
+    if (types & WPEQtWebsiteData::DomCache)
+        result |= WEBKIT_WEBSITE_DATA_DOM_CACHE;
+#endif
+    return static_cast<WebKitWebsiteDataTypes>(result);
+}
+
+static int dataTypes(unsigned types)
+{
+    int result = 0;
+    if (types & WEBKIT_WEBSITE_DATA_MEMORY_CACHE)
+        result |= WPEQtWebsiteData::MemoryCache;
+    if (types & WEBKIT_WEBSITE_DATA_DISK_CACHE)
+        result |= WPEQtWebsiteData::DiskCache;
+    if (types & WEBKIT_WEBSITE_DATA_OFFLINE_APPLICATION_CACHE)
+        result |= WPEQtWebsiteData::OfflineApplicationCache;
+    if (types & WEBKIT_WEBSITE_DATA_SESSION_STORAGE)
+        result |= WPEQtWebsiteData::SessionStorage;
+    if (types & WEBKIT_WEBSITE_DATA_LOCAL_STORAGE)
+        result |= WPEQtWebsiteData::LocalStorage;
+    if (types & WEBKIT_WEBSITE_DATA_INDEXEDDB_DATABASES)
+        result |= WPEQtWebsiteData::IndexedDBDatabases;
+    if (types & WEBKIT_WEBSITE_DATA_COOKIES)
+        result |= WPEQtWebsiteData::Cookies;
+#if WEBKIT_CHECK_VERSION(2, 30, 0)
+    if (types & WEBKIT_WEBSITE_DATA_SERVICE_WORKER_REGISTRATIONS)
+        result |= WPEQtWebsiteData::ServiceWorkerRegistrations;
+    if (types & WEBKIT_WEBSITE_DATA_DOM_CACHE)
+        result |= WPEQtWebsiteData::DomCache;
+#endif
+    return result;
+}
+
+static WebKitCacheModel webkitCacheModel(WPEQtWebsiteData::CacheModel model)
+{
+    switch (model) {
+    case WPEQtWebsiteData::DocumentViewerCacheModel:
+        return WEBKIT_CACHE_MODEL_DOCUMENT_VIEWER;
+    case WPEQtWebsiteData::DocumentBrowserCacheModel:
+        return WEBKIT_CACHE_MODEL_DOCUMENT_BROWSER;
+    case WPEQtWebsiteData::WebBrowserCacheModel:
+        break;
+    }
+    return WEBKIT_CACHE_MODEL_WEB_BROWSER;
+}
+
+/*!
+  \qmltype WPEWebsiteData
+  \instantiates WPEQtWebsiteData
+  \inqmlmodule org.wpewebkit.qtwpe
+
+  \brief Configures where and how the website data of WPEView is stored.
+
+  Views sharing a WPEWebsiteData object, through WPEView::websiteData, share
+  their HTTP cache, cookies and storage. Views without one use the default
+  storage of WebKit.
+
+  The storage is created when the first view using it is, its directories,
+  ephemeral mode and storage ratios can not be changed afterwards.
+
+  \badcode
+  WPEWebsiteData {
+      id: websiteData
+      dataDirectory: "/var/lib/kiosk/web"
+      cacheDirectory: "/var/cache/kiosk/web"
+      cacheModel: WPEWebsiteData.DocumentBrowserCacheModel
+  }
+
+  WPEView {
+      websiteData: websiteData
+      url: "https://example.com/"
+  }
+  \endcode
+*/
+WPEQtWebsiteData::WPEQtWebsiteData(QObject* parent)
+    : QObject(parent)
+{
+}
+
+WPEQtWebsiteData::~WPEQtWebsiteData()
+{
+}
+
+bool WPEQtWebsiteData::canConfigure(const char* property) const
+{
+    if (!m_webContext)
+        return true;
+
+    qWarning("WPEWebsiteData.%s can not be changed once the storage is in use", property);
+    return false;
+}
+
+/*!
+  \qmlproperty string WPEWebsiteData::dataDirectory
+
+  The directory below which persistent data, such as local storage,
+  IndexedDB databases and service workers, is stored. WebKit's default
+  location is used when empty.
+*/
+void WPEQtWebsiteData::setDataDirectory(const QString& directory)
+{
+    if (directory == m_dataDirectory || !canConfigure("dataDirectory"))
+        return;
+
+    m_dataDirectory = directory;
+    Q_EMIT dataDirectoryChanged();
+}
+
+/*!
+  \qmlproperty string WPEWebsiteData::cacheDirectory
+
+  The directory below which the HTTP disk cache and other caches are
+  stored. WebKit's default location is used when empty.
+*/
+void WPEQtWebsiteData::setCacheDirectory(const QString& directory)
+{
+    if (directory == m_cacheDirectory || !canConfigure("cacheDirectory"))
+        return;
+
+    m_cacheDirectory = directory;
+    Q_EMIT cacheDirectoryChanged();
+}
+
+/*!
+  \qmlproperty bool WPEWebsiteData::ephemeral
+
+  When \c true nothing is written to disk, all website data is kept in
+  memory and lost when the application exits.
+*/
+void WPEQtWebsiteData::setEphemeral(bool ephemeral)
+{
+    if (ephemeral == m_ephemeral || !canConfigure("ephemeral"))
+        return;
+
+    m_ephemeral = ephemeral;
+    Q_EMIT ephemeralChanged();
+}
+
+/*!
+  \qmlproperty enumeration WPEWebsiteData::cacheModel
+
+  How much memory and disk space WebKit uses for caching.
+
+  \value WPEWebsiteData.DocumentViewerCacheModel Caching is disabled, for
+         applications showing local content.
+  \value WPEWebsiteData.WebBrowserCacheModel The default, caching as a web
+         browser would.
+  \value WPEWebsiteData.DocumentBrowserCacheModel Moderate caching, for
+         applications browsing a limited set of documents.
+*/
+void WPEQtWebsiteData::setCacheModel(CacheModel model)
+{
+    if (model == m_cacheModel)
+        return;
+
+    m_cacheModel = model;
+    if (m_webContext)
+        webkit_web_context_set_cache_model(m_webContext.get(), webkitCacheModel(m_cacheModel));
+    Q_EMIT cacheModelChanged();
+}
+
+/*!
+  \qmlproperty real WPEWebsiteData::originStorageRatio
+
+  The fraction of the volume holding dataDirectory that each origin may use
+  for its storage, or -1 to use WebKit's default quota.
+
+  Only supported with WPE WebKit 2.42 or later and the wpe-webkit-1.x API.
+
+  \sa totalStorageRatio
+*/
+void WPEQtWebsiteData::setOriginStorageRatio(qreal ratio)
+{
+    if (ratio == m_originStorageRatio || !canConfigure("originStorageRatio"))
+        return;
+
+    m_originStorageRatio = ratio;
+    Q_EMIT originStorageRatioChanged();
+}
+
+/*!
+  \qmlproperty real WPEWebsiteData::totalStorageRatio
+
+  The fraction of the volume holding dataDirectory that all origins
+  together may use for their storage, or -1 for no limit.
+
+  Only supported with WPE WebKit 2.42 or later and the wpe-webkit-1.x API.
+
+  \sa originStorageRatio
+*/
+void WPEQtWebsiteData::setTotalStorageRatio(qreal ratio)
+{
+    if (ratio == m_totalStorageRatio || !canConfigure("totalStorageRatio"))
+        return;
+
+    m_totalStorageRatio = ratio;
+    Q_EMIT totalStorageRatioChanged();
+}
+
+void WPEQtWebsiteData::create()
+{
+    if (m_webContext)
+        return;
+
+    const QByteArray dataDirectory = m_ephemeral ? QByteArray() : QFile::encodeName(m_dataDirectory);
+    const QByteArray cacheDirectory = m_ephemeral ? QByteArray() : QFile::encodeName(m_cacheDirectory);
+#ifdef USE_2022_GLIB_API
+    if (m_ephemeral)
+        m_networkSession = adoptGRef(webkit_network_session_new_ephemeral());
+    else {
+        m_networkSession = adoptGRef(webkit_network_session_new(dataDirectory.isEmpty() ? nullptr : dataDirectory.constData(),
+            cacheDirectory.isEmpty() ? nullptr : cacheDirectory.constData()));
+    }
+    m_webContext = adoptGRef(webkit_web_context_new());
+#else
+    auto manager = adoptGRef(webkit_website_data_manager_new(
+        "is-ephemeral", gboolean(m_ephemeral),
+        "base-data-directory", dataDirectory.isEmpty() ? nullptr : dataDirectory.constData(),
+        "base-cache-directory", cacheDirectory.isEmpty() ? nullptr : cacheDirectory.constData(),
+#if WEBKIT_CHECK_VERSION(2, 42, 0)
+        "origin-storage-ratio", gdouble(m_originStorageRatio),
+        "total-storage-ratio", gdouble(m_totalStorageRatio),
+#endif
+        nullptr));
+    m_webContext = adoptGRef(webkit_web_context_new_with_website_data_manager(manager.get()));
+#endif
+    webkit_web_context_set_cache_model(m_webContext.get(), webkitCacheModel(m_cacheModel));
+}
+
+WebKitWebContext* WPEQtWebsiteData::webContext()
+{
+    create();
+    return m_webContext.get();
+}
+
+#ifdef USE_2022_GLIB_API
+WebKitNetworkSession* WPEQtWebsiteData::networkSession()
+{
+    create();
+    return m_networkSession.get();
+}
+#endif
+
+WebKitWebsiteDataManager* WPEQtWebsiteData::manager()
+{
+#ifdef USE_2022_GLIB_API
+    return webkit_network_session_get_website_data_manager(networkSession());
+#else
+    return webkit_web_context_get_website_data_manager(webContext());
+#endif
+}
+
+/*!
+  \qmlmethod void WPEWebsiteData::clear(int types, variant callback, int timeSpan)
+
+  Asynchronously removes the website data of the given \a types, a
+  combination of the WPEWebsiteData.DataType flags such as
+  \c{WPEWebsiteData.DiskCache | WPEWebsiteData.Cookies}, or
+  \c WPEWebsiteData.AllDataTypes. When \a timeSpan is not 0, only data
+  modified in the last \a timeSpan seconds is removed.
+
+  The \a callback, if any, receives \c true once the data was removed.
+*/
+void WPEQtWebsiteData::clear(int types, const QJSValue& callback, int timeSpan)
+{
+    auto* data = new WebsiteDataCallbackData { callback, QPointer<WPEQtWebsiteData>(this) };
+    webkit_website_data_manager_clear(manager(), webkitDataTypes(types), GTimeSpan(timeSpan) * G_TIME_SPAN_SECOND,
+        nullptr, clearCallback, data);
+}
+
+void WPEQtWebsiteData::clearCallback(GObject* object, GAsyncResult* result, gpointer userData)
+{
+    std::unique_ptr<WebsiteDataCallbackData> data(static_cast<WebsiteDataCallbackData*>(userData));
+    GUniqueOutPtr<GError> error;
+    bool cleared = webkit_website_data_manager_clear_finish(WEBKIT_WEBSITE_DATA_MANAGER(object), result, &error.outPtr());
+    if (!cleared)
+        qWarning("Failed to clear website data: %s", error->message);
+
+    if (data->object && data->callback.isCallable())
+        data->callback.call(QJSValueList { cleared });
+}
+
+/*!
+  \qmlmethod void WPEWebsiteData::fetch(int types, variant callback)
+
+  Asynchronously lists the website data of the given \a types. The
+  \a callback receives an array with one object per website, holding its
+  \c name, the \c types of data stored for it, and the \c size of its disk
+  cache data in bytes.
+*/
+void WPEQtWebsiteData::fetch(int types, const QJSValue& callback)
+{
+    auto* data = new WebsiteDataCallbackData { callback, QPointer<WPEQtWebsiteData>(this) };
+    webkit_website_data_manager_fetch(manager(), webkitDataTypes(types), nullptr, fetchCallback, data);
+}
+
+void WPEQtWebsiteData::fetchCallback(GObject* object, GAsyncResult* result, gpointer userData)
+{
+    std::unique_ptr<WebsiteDataCallbackData> data(static_cast<WebsiteDataCallbackData*>(userData));
+    GUniqueOutPtr<GError> error;
+    GList* list = webkit_website_data_manager_fetch_finish(WEBKIT_WEBSITE_DATA_MANAGER(object), result, &error.outPtr());
+    if (error)
+        qWarning("Failed to fetch website data: %s", error->message);
+
+    QVariantList websites;
+    for (GList* item = list; item; item = item->next) {
+        auto* websiteData = static_cast<WebKitWebsiteData*>(item->data);
+        const WebKitWebsiteDataTypes types = webkit_website_data_get_types(websiteData);
+        QVariantMap website;
+        website.insert(QStringLiteral("name"), QString::fromUtf8(webkit_website_data_get_name(websiteData)));
+        website.insert(QStringLiteral("types"), dataTypes(types));
+        website.insert(QStringLiteral("size"), quint64(webkit_website_data_get_size(websiteData, types)));
+        websites.append(website);
+    }
+    g_list_free_full(list, reinterpret_cast<GDestroyNotify>(webkit_website_data_unref));
+
+    if (!data->object || !data->callback.isCallable())
+        return;
+
+    QQmlEngine* engine = qmlEngine(data->object.data());
+    if (!engine) {
+        qWarning("No JavaScript engine, unable to handle JavaScript callback!");
+        return;
+    }
+    data->callback.call(QJSValueList { engine->toScriptValue(websites) });
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <QJSValue>
+#include <QObject>
+#include <QString>
+#include <wpe/webkit.h>
+#include <wtf/glib/GRefPtr.h>
+
+class WPEQtWebsiteData : public QObject {
+    Q_OBJECT
+    Q_DISABLE_COPY(WPEQtWebsiteData)
+    Q_PROPERTY(QString dataDirectory READ dataDirectory WRITE setDataDirectory NOTIFY dataDirectoryChanged)
+    Q_PROPERTY(QString cacheDirectory READ cacheDirectory WRITE setCacheDirectory NOTIFY cacheDirectoryChanged)
+    Q_PROPERTY(bool ephemeral READ isEphemeral WRITE setEphemeral NOTIFY ephemeralChanged)
+    Q_PROPERTY(CacheModel cacheModel READ cacheModel WRITE setCacheModel NOTIFY cacheModelChanged)
+    Q_PROPERTY(qreal originStorageRatio READ originStorageRatio WRITE setOriginStorageRatio NOTIFY originStorageRatioChanged)
+    Q_PROPERTY(qreal totalStorageRatio READ totalStorageRatio WRITE setTotalStorageRatio NOTIFY totalStorageRatioChanged)
+    Q_ENUMS(CacheModel)
+    Q_ENUMS(DataType)
+
+public:
+    enum CacheModel {
+        DocumentViewerCacheModel,
+        WebBrowserCacheModel,
+        DocumentBrowserCacheModel
+    };
+
+    enum DataType {
+        MemoryCache = 1 << 0,
+        DiskCache = 1 << 1,
+        OfflineApplicationCache = 1 << 2,
+        SessionStorage = 1 << 3,
+        LocalStorage = 1 << 4,
+        IndexedDBDatabases = 1 << 5,
+        Cookies = 1 << 6,
+        ServiceWorkerRegistrations = 1 << 7,
+        DomCache = 1 << 8,
+        AllDataTypes = (1 << 9) - 1
+    };
+
+    explicit WPEQtWebsiteData(QObject* parent = nullptr);
+    ~WPEQtWebsiteData();
+
+    QString dataDirectory() const { return m_dataDirectory; }
+    void setDataDirectory(const QString&);
+    QString cacheDirectory() const { return m_cacheDirectory; }
+    void setCacheDirectory(const QString&);
+    bool isEphemeral() const { return m_ephemeral; }
+    void setEphemeral(bool);
+    CacheModel cacheModel() const { return m_cacheModel; }
+    void setCacheModel(CacheModel);
+    qreal originStorageRatio() const { return m_originStorageRatio; }
+    void setOriginStorageRatio(qreal);
+    qreal totalStorageRatio() const { return m_totalStorageRatio; }
+    void setTotalStorageRatio(qreal);
+
+    // The storage is created on first use, after which only the cache
+    // model can change.
+    WebKitWebContext* webContext();
+#ifdef USE_2022_GLIB_API
+    WebKitNetworkSession* networkSession();
+#endif
+    WebKitWebsiteDataManager* manager();
+
+public Q_SLOTS:
+    void clear(int types, const QJSValue& callback = QJSValue(), int timeSpan = 0);
+    void fetch(int types, const QJSValue& callback);
+
+Q_SIGNALS:
+    void dataDirectoryChanged();
+    void cacheDirectoryChanged();
+    void ephemeralChanged();
+    void cacheModelChanged();
+    void originStorageRatioChanged();
+    void totalStorageRatioChanged();
+
+private:
+    static void clearCallback(GObject*, GAsyncResult*, gpointer);
+    static void fetchCallback(GObject*, GAsyncResult*, gpointer);
+
+    bool canConfigure(const char* property) const;
+    void create();
+
+    QString m_dataDirectory;
+    QString m_cacheDirectory;
+    bool m_ephemeral { false };
+    CacheModel m_cacheModel { WebBrowserCacheModel };
+    qreal m_originStorageRatio { -1 };
+    qreal m_totalStorageRatio { -1 };
+
+    GRefPtr<WebKitWebContext> m_webContext;
+#ifdef USE_2022_GLIB_API
+    GRefPtr<WebKitNetworkSession> m_networkSession;
+#endif
+};
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include "WPEQtUrlMatcher.h"
+
+#include <QTest>
+
+class tst_UrlMatcher : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void match_data();
+    void match();
+    void hostOfUrl_data();
+    void hostOfUrl();
+};
+
+void tst_UrlMatcher::match_data()
+{
+    QTest::addColumn<QStringList>("rules");
+    QTest::addColumn<QByteArray>("url");
+    QTest::addColumn<int>("rule");
+
+    const QStringList hosts = { "example.com", "*.example.org" };
+    QTest::newRow("host") << hosts << QByteArray("https://example.com/") << 0;
+    QTest::newRow("host with user info") << hosts << QByteArray("https://user@example.com/") << 0;
+    QTest::newRow("host with port") << hosts << QByteArray("https://example.com:8080/") << 0;
+    QTest::newRow("host is case insensitive") << hosts << QByteArray("https://EXAMPLE.com/") << 0;
+    QTest::newRow("host subdomain") << hosts << QByteArray("https://www.example.com/") << -1;
+    QTest::newRow("host suffix") << hosts << QByteArray("https://badexample.com/") << -1;
+    QTest::newRow("host in user info") << hosts << QByteArray("https://example.com@evil.net/") << -1;
+    QTest::newRow("subdomain") << hosts << QByteArray("https://a.b.example.org/") << 1;
+    QTest::newRow("subdomain parent") << hosts << QByteArray("https://example.org/") << -1;
+
+    const QStringList prefixes = { "https://example.com", "https://example.net/app/", "qrc:" };
+    QTest::newRow("origin") << prefixes << QByteArray("https://example.com") << 0;
+    QTest::newRow("origin path") << prefixes << QByteArray("https://example.com/a") << 0;
+    QTest::newRow("origin query") << prefixes << QByteArray("https://example.com?a") << 0;
+    QTest::newRow("origin port") << prefixes << QByteArray("https://example.com:8443/") << 0;
+    QTest::newRow("origin longer host") << prefixes << QByteArray("https://example.com.evil.net/") << -1;
+    QTest::newRow("origin user info") << prefixes << QByteArray("https://example.com@evil.net/") << -1;
+    QTest::newRow("origin password") << prefixes << QByteArray("https://example.com:x@evil.net/") << -1;
+    QTest::newRow("origin numeric password") << prefixes << QByteArray("https://example.com:80@evil.net/") << -1;
+    QTest::newRow("path") << prefixes << QByteArray("https://example.net/app/index.html") << 1;
+    QTest::newRow("path sibling") << prefixes << QByteArray("https://example.net/other/") << -1;
+    QTest::newRow("scheme") << prefixes << QByteArray("qrc:/main.html") << 2;
+
+    const QStringList nested = { "https://example.com/", "https://example.com/app/" };
+    QTest::newRow("longest prefix") << nested << QByteArray("https://example.com/app/a") << 1;
+    QTest::newRow("shorter prefix") << nested << QByteArray("https://example.com/b") << 0;
+}
+
+void tst_UrlMatcher::match()
+{
+    QFETCH(QStringList, rules);
+    QFETCH(QByteArray, url);
+    QFETCH(int, rule);
+
+    WPEQtUrlMatcher matcher;
+    matcher.setRules(rules);
+    QCOMPARE(matcher.match(url), rule);
+}
+
+void tst_UrlMatcher::hostOfUrl_data()
+{
+    QTest::addColumn<QByteArray>("url");
+    QTest::addColumn<QByteArray>("host");
+
+    QTest::newRow("plain") << QByteArray("https://Example.com/a") << QByteArray("example.com");
+    QTest::newRow("port") << QByteArray("http://example.com:80") << QByteArray("example.com");
+    QTest::newRow("user info") << QByteArray("https://a:b@example.com/") << QByteArray("example.com");
+    QTest::newRow("ipv6") << QByteArray("http://[::1]:8080/") << QByteArray("::1");
+    QTest::newRow("no authority") << QByteArray("about:blank") << QByteArray();
+}
+
+void tst_UrlMatcher::hostOfUrl()
+{
+    QFETCH(QByteArray, url);
+    QFETCH(QByteArray, host);
+
+    QCOMPARE(WPEQtUrlMatcher::hostOfUrl(url), host);
+}
+
+QTEST_APPLESS_MAIN(tst_UrlMatcher)
+
+#include "tst_urlmatcher.moc"
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2018, 2019 Igalia S.L
+ * Copyright (C) 2018, 2019 Zodiac Inflight Innovations
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "WPEQtAssetPackFormat.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace WPEQtAssetPackFormat;
+
+struct PackedFile {
+    QByteArray path;
+    QByteArray data;
+    quint32 size;
+    bool compressed;
+};
+
+static bool isCompressible(const QString& fileName)
+{
+    static const QStringList compressedSuffixes = {
+        QStringLiteral("br"), QStringLiteral("gif"), QStringLiteral("gz"), QStringLiteral("jpeg"),
+        QStringLiteral("jpg"), QStringLiteral("mp3"), QStringLiteral("mp4"), QStringLiteral("ogg"),
+        QStringLiteral("png"), QStringLiteral("webm"), QStringLiteral("webp"), QStringLiteral("woff"),
+        QStringLiteral("woff2"), QStringLiteral("zip")
+    };
+    return !compressedSuffixes.contains(QFileInfo(fileName).suffix().toLower());
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("wpeqt-pack"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Packs the files of a directory into an asset pack for WPEView.registerAssetPack()."));
+    parser.addHelpOption();
+    QCommandLineOption compressOption({ QStringLiteral("c"), QStringLiteral("compress") },
+        QStringLiteral("Store compressible files as zlib streams."));
+    parser.addOption(compressOption);
+    parser.addPositionalArgument(QStringLiteral("directory"), QStringLiteral("Directory to pack."));
+    parser.addPositionalArgument(QStringLiteral("output"), QStringLiteral("Asset pack to write."));
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.size() != 2)
+        parser.showHelp(1);
+
+    const QDir root(arguments.at(0));
+    if (!root.exists()) {
+        qCritical("No such directory: %s", qPrintable(arguments.at(0)));
+        return 1;
+    }
+
+    std::vector<PackedFile> files;
+    QDirIterator it(root.absolutePath(), QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString filePath = it.next();
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical("Failed to read %s", qPrintable(filePath));
+            return 1;
+        }
+
+        PackedFile packed;
+        packed.path = '/' + root.relativeFilePath(filePath).toUtf8();
+        packed.data = file.readAll();
+        packed.size = packed.data.size();
+        packed.compressed = false;
+        if (parser.isSet(compressOption) && !packed.data.isEmpty() && isCompressible(filePath)) {
+            // qCompress prepends the uncompressed size to the zlib stream.
+            QByteArray compressed = qCompress(packed.data, 9).mid(4);
+            if (compressed.size() < packed.data.size() / 10 * 9) {
+                packed.data = compressed;
+                packed.compressed = true;
+            }
+        }
+        files.push_back(std::move(packed));
+    }
+
+    // The plugin looks paths up with a binary search.
+    std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) {
+        return a.path < b.path;
+    });
+
+    const quint64 pathsOffset = sizeof(Header) + files.size() * sizeof(Entry);
+    quint64 pathsSize = 0;
+    for (const auto& file : files)
+        pathsSize += file.path.size();
+
+    Header header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = qToLittleEndian(version);
+    header.entryCount = qToLittleEndian(quint32(files.size()));
+
+    std::vector<Entry> entries;
+    entries.reserve(files.size());
+    quint64 pathOffset = pathsOffset;
+    quint64 dataOffset = pathsOffset + pathsSize;
+    for (const auto& file : files) {
+        Entry entry;
+        entry.pathOffset = qToLittleEndian(quint32(pathOffset));
+        entry.pathLength = qToLittleEndian(quint32(file.path.size()));
+        entry.dataOffset = qToLittleEndian(dataOffset);
+        entry.storedSize = qToLittleEndian(quint32(file.data.size()));
+        entry.size = qToLittleEndian(file.size);
+        entry.flags = qToLittleEndian(quint32(file.compressed ? Compressed : 0));
+        entry.reserved = 0;
+        entries.push_back(entry);
+        pathOffset += file.path.size();
+        dataOffset += file.data.size();
+    }
+
+    QSaveFile output(arguments.at(1));
+    if (!output.open(QIODevice::WriteOnly)) {
+        qCritical("Failed to write %s", qPrintable(arguments.at(1)));
+        return 1;
+    }
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+    for (const auto& file : files)
+        output.write(file.path);
+    for (const auto& file : files)
+        output.write(file.data);
+    if (!output.commit()) {
+        qCritical("Failed to write %s", qPrintable(arguments.at(1)));
+        return 1;
+    }
+
+    qInfo("Packed %zu files, %llu bytes", files.size(), dataOffset);
+    return 0;
+}